@@ -5,6 +5,13 @@
 #include "include/stb_image_resize.h"
 
 
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <optional>
+#include <thread>
+
 extern "C" {
     #include <libavcodec/avcodec.h>
     #include <libavformat/avformat.h>
@@ -12,15 +19,27 @@ extern "C" {
 }
 
 #include "include/ai_manager.hpp"
-
-AIManager::AIManager()
-: a_env(ORT_LOGGING_LEVEL_WARNING, "AIvoice"),
-  a_session(nullptr), a_encoder_session(nullptr), a_decoder_session(nullptr),
-  a_image_model_loaded(false), a_audio_model_loaded(false),
-  a_sample_rate(16000), a_channles(1), a_n_fft(400), a_hop_length(160), a_n_mel(80)
+#include "include/av_decoding.hpp"
+#include "include/bounded_queue.hpp"
+#include "include/chunk_stream.hpp"
+#include "include/parallel.hpp"
+#include "include/pcm_input.hpp"
+#include "include/resampler.hpp"
+
+AIManager::AIManager(const AIManagerOptions & options)
+: a_options(options), a_env(ORT_LOGGING_LEVEL_WARNING, "AIvoice"),
+  a_session(nullptr), a_encoder_session(nullptr), a_decoder_session(nullptr), a_decoder_with_past_session(nullptr),
+  a_vad_session(nullptr),
+  a_image_model_loaded(false), a_image_run_batch(1), a_audio_model_loaded(false),
+  a_sample_rate(16000), a_channles(1), a_n_fft(400), a_hop_length(160), a_n_mel(80),
+  a_mel_frontend(a_sample_rate, a_n_fft, a_hop_length, a_n_mel),
+  a_chunk_planner(a_options.chunking),
+  a_decoder_pool(a_options.audio_decoder_pool, static_cast<int>(a_options.preprocess_threads)),
+  a_preprocess_pool(std::max<size_t>(a_options.preprocess_threads, 1) - 1),
+  a_sot_token(50257), a_eot_token(50256), a_no_speech_token(-1), a_no_timestamps_token(-1), a_blank_token(-1)
 {
-    load_labels("../labels/imagenet_classes.txt");
-    load_whisper_vocab("../labels/whisper_vocab.json");
+    load_labels(a_options.labels_path);
+    load_whisper_vocab(a_options.vocab_path);
     av_log_set_level(AV_LOG_QUIET);
 }
 
@@ -28,6 +47,17 @@ AIManager::~AIManager(){
 
 }
 
+Ort::SessionOptions AIManager::make_session_options() const{
+    Ort::SessionOptions session_options;
+    if(a_options.intra_op_threads > 0){
+        session_options.SetIntraOpNumThreads(a_options.intra_op_threads);
+    }
+    if(a_options.inter_op_threads > 0){
+        session_options.SetInterOpNumThreads(a_options.inter_op_threads);
+    }
+    return session_options;
+}
+
 void AIManager::load_whisper_vocab(const std::string & vocab_path){
     std::ifstream infile(vocab_path);
     if(!infile.is_open()){
@@ -42,6 +72,35 @@ void AIManager::load_whisper_vocab(const std::string & vocab_path){
     for(const auto & item : vocab_map.items()){
         a_whisper_vocab[item.value().get<int64_t>()] = item.key();
     }
+    //special tokens live outside the BPE vocab
+    if(vocab_json.contains("added_tokens")){
+        for(const auto & token : vocab_json["added_tokens"]){
+            a_whisper_vocab[token["id"].get<int64_t>()] = token["content"].get<std::string>();
+        }
+    }
+
+    auto find_token = [this](const std::string & text) -> int64_t {
+        for(const auto & [id, token] : a_whisper_vocab){
+            if(token == text){
+                return id;
+            }
+        }
+        return -1;
+    };
+    if(int64_t id = find_token("<|endoftext|>"); id >= 0){
+        a_eot_token = id;
+    }
+    if(int64_t id = find_token("<|startoftranscript|>"); id >= 0){
+        a_sot_token = id;
+    }
+    //renamed from <|nocaptions|> in the later tokenizers
+    a_no_speech_token = find_token("<|nospeech|>");
+    if(a_no_speech_token < 0){
+        a_no_speech_token = find_token("<|nocaptions|>");
+    }
+    a_no_timestamps_token = find_token("<|notimestamps|>");
+    //a lone space in byte-level BPE
+    a_blank_token = find_token("\u0120");
 
     std::cout << "Loaded" << a_whisper_vocab.size() << " Whisper tokens." << std::endl;
 
@@ -69,15 +128,14 @@ void AIManager::get_input_output_name(const Ort::Session & session){
 
 }
 
-void AIManager::load_audio_model(const std::string & encoder_path, const std::string & decoder_path){
+void AIManager::load_audio_model(const std::string & encoder_path, const std::string & decoder_path, const std::string & decoder_with_past_path){
     if(a_audio_model_loaded){
         std::cout << "Audio models already loaded." << std::endl;
         return;
     }
     try
     {
-        Ort::SessionOptions seesion_options;
-        seesion_options.SetIntraOpNumThreads(1);
+        Ort::SessionOptions seesion_options = make_session_options();
 
         a_encoder_session = Ort::Session(a_env, encoder_path.c_str(), seesion_options);
         a_decoder_session = Ort::Session(a_env, decoder_path.c_str(), seesion_options);
@@ -85,6 +143,46 @@ void AIManager::load_audio_model(const std::string & encoder_path, const std::st
         get_input_output_name(a_encoder_session);
         get_input_output_name(a_decoder_session);
 
+        Ort::Session * decoder_with_past = nullptr;
+        if(!decoder_with_past_path.empty()){
+            if(std::filesystem::exists(decoder_with_past_path)){
+                a_decoder_with_past_session = Ort::Session(a_env, decoder_with_past_path.c_str(), seesion_options);
+                get_input_output_name(a_decoder_with_past_session);
+                decoder_with_past = &a_decoder_with_past_session;
+            }else{
+                std::cerr << "Decoder with past not found: " << decoder_with_past_path << ", decoding without the KV cache." << std::endl;
+            }
+        }
+        a_whisper_decoder = std::make_unique<AIvoice::WhisperDecoder>(a_decoder_session, decoder_with_past, make_logits_processor(a_decoder_session));
+
+        if(a_options.vad.enabled){
+            Ort::Session * vad_model = nullptr;
+            if(!a_options.vad.model_path.empty()){
+                a_vad_session = Ort::Session(a_env, a_options.vad.model_path.c_str(), seesion_options);
+                vad_model = &a_vad_session;
+            }
+            a_vad = std::make_unique<AIvoice::VoiceActivityDetector>(a_options.vad, vad_model);
+        }
+
+        // a fixed leading dimension means the export only takes one chunk per run
+        AIvoice::MicroBatcherOptions encoder_options = a_options.encoder_batching;
+        auto encoder_input_shape = a_encoder_session.GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if(!encoder_input_shape.empty() && encoder_input_shape[0] > 0){
+            std::cout << "Encoder has a fixed batch of " << encoder_input_shape[0] << ", not batching chunks." << std::endl;
+            encoder_options.max_batch = 1;
+        }
+        if(encoder_options.max_batch > 1){
+            a_encoder_batcher = std::make_unique<AIvoice::MicroBatcher<std::vector<float>, Ort::Value>>(
+                [this](std::vector<std::vector<float>> & features){
+                    return run_encoder_batch(features);
+                },
+                encoder_options
+            );
+        }
+        if(a_options.decoder_batching.max_batch > 1){
+            a_decoder_scheduler = std::make_unique<AIvoice::DecoderScheduler>(*a_whisper_decoder, a_options.decoder_batching);
+        }
+
         a_audio_model_loaded = true;
         std::cout << "Audio models loaded successfully." << std::endl;
     }
@@ -96,287 +194,570 @@ void AIManager::load_audio_model(const std::string & encoder_path, const std::st
     
 }
 
-void AIManager::computeFFT(const std::vector<float> & input, std::vector<float> & output_magnitude){
-    int N = input.size();
-    if(N == 0) return;
-
-    std::vector<std::complex<float>> C(N);
-    for(int i = 0; i < N; ++i){
-        C[i] = std::complex<float>(input[i], 0.0f);
-    }
-
-    std::vector<std::complex<float>> X(N);
-    for(int k = 0; k < N / 2; ++k){
-        std::complex<float> sum(0.0f, 0.0f);
-        for(int n = 0; n < N; ++n){
-            float angle = -2.0f * M_PI * k * n / N;
-            sum += C[n] * std::complex<float>(std::cos(angle), std::sin(angle));
+AIvoice::LogitsProcessor AIManager::make_logits_processor(const Ort::Session & decoder) const{
+    //logits are [batch, length, vocab]; a dynamic vocab falls back to the tokenizer's
+    int64_t vocab_size = -1;
+    Ort::AllocatorWithDefaultOptions allocator;
+    for(size_t i = 0; i < decoder.GetOutputCount(); ++i){
+        if(std::string(decoder.GetOutputNameAllocated(i, allocator).get()) == "logits"){
+            vocab_size = decoder.GetOutputTypeInfo(i).GetTensorTypeAndShapeInfo().GetShape().back();
         }
-        X[k] = sum;
+    }
+    if(vocab_size <= 0 && !a_whisper_vocab.empty()){
+        vocab_size = a_whisper_vocab.rbegin()->first + 1;
     }
 
-    output_magnitude.resize(N / 2 + 1);
-    for(int i = 0; i < N / 2 + 1; ++i){
-        output_magnitude[i] = std::abs(X[i]);
+    std::vector<int64_t> suppressed = a_options.suppress_tokens;
+    for(int64_t id = a_eot_token + 1; id < vocab_size; ++id){
+        suppressed.push_back(id);
+    }
+    std::vector<int64_t> suppressed_at_begin;
+    if(a_options.suppress_blank){
+        suppressed_at_begin = {a_eot_token};
+        if(a_blank_token >= 0){
+            suppressed_at_begin.push_back(a_blank_token);
+        }
     }
+    return AIvoice::LogitsProcessor(vocab_size, suppressed, suppressed_at_begin, a_no_speech_token);
 }
 
-std::vector<std::vector<float>> AIManager::create_mel_filter_bank(){
-    std::vector<std::vector<float>> filters(a_n_mel, std::vector<float>(a_n_fft / 2 + 1, 0.0f));
-    
-    auto hz_to_mel = [](float hz){return 2595.0f * std::log10(1.0f + hz / 700.0f);};
-    auto mel_to_hz = [](float mel){return 700.0f * (std::pow(10.0f, mel / 2595.0f) - 1.0f);};
+AIManager::DecodingWindow AIManager::start_decoding(std::vector<Ort::Value> encoder_outputs, AIvoice::WhisperDecoder::Workspace & workspace){
+    //timestamp tokens are suppressed, so the model is told it writes none;
+    //the no-speech probability is still read at sot
+    std::vector<int64_t> prompt {a_sot_token};
+    if(a_no_timestamps_token >= 0){
+        prompt.push_back(a_no_timestamps_token);
+    }
+    const int64_t EOT_TOKEN = a_eot_token;
+    const int MAX_LENGTH = 200;
 
-    float mel_min = hz_to_mel(0.0f);
-    float mel_max = hz_to_mel(a_sample_rate / 2.0f);
+    DecodingWindow window;
+    window.encoder_outputs = std::move(encoder_outputs);
 
-    std::vector<float> mel_points(a_n_mel + 2);
-    for(int i = 0; i < a_n_mel + 2; ++i){
-        mel_points[i] = mel_min + (mel_max - mel_min) / (a_n_mel + 1) * i;
+    //with the scheduler every chunk is in flight at once, so they share steps
+    //with each other and with other transcriptions
+    for(const auto & encoder_output : window.encoder_outputs){
+        if(a_decoder_scheduler){
+            window.results.push_back(a_decoder_scheduler->submit(encoder_output, prompt, EOT_TOKEN, MAX_LENGTH, a_options.decode_guard));
+        }else{
+            std::promise<AIvoice::DecodeResult> result;
+            result.set_value(a_whisper_decoder->decode(encoder_output, prompt, EOT_TOKEN, MAX_LENGTH, a_options.decode_guard, workspace));
+            window.results.push_back(result.get_future());
+        }
     }
+    return window;
+}
 
-    std::vector<float> hz_points(a_n_mel + 2);
-    for(int i = 0; i < a_n_mel + 2; ++i){
-        hz_points[i] = mel_to_hz(mel_points[i]);
+std::string AIManager::finish_decoding(DecodingWindow & window, nlohmann::json & chunk_reports){
+    std::string transcribed_text;
+    for(auto & pending : window.results){
+        AIvoice::DecodeResult result = pending.get();
+
+        nlohmann::json chunk_report;
+        chunk_report["stop"] = AIvoice::stop_reason_name(result.stop_reason);
+        chunk_report["tokens"] = result.tokens.size();
+        chunk_report["decoder_steps"] = result.steps;
+        chunk_report["attempts"] = result.attempts;
+        chunk_report["temperature"] = result.temperature;
+        chunk_report["avg_logprob"] = result.avg_logprob;
+        chunk_report["compression_ratio"] = result.compression_ratio;
+        chunk_report["no_speech_prob"] = result.no_speech_prob;
+        chunk_reports.push_back(std::move(chunk_report));
+
+        for(int64_t token_id : result.tokens){
+            //eot and the special tokens carry no text
+            if(token_id >= a_eot_token){
+                continue;
+            }
+            auto it = a_whisper_vocab.find(token_id);
+            if(it != a_whisper_vocab.end()){
+                transcribed_text += it->second;
+            }else{
+                transcribed_text += "[UNK]";
+            }
+        }
     }
+    return transcribed_text;
+}
 
-    std::vector<int> bin_points(a_n_mel + 2);
-    for(int i = 0; i < a_n_mel + 2; ++i){
-        bin_points[i] = static_cast<int>(std::floor((a_n_fft / 2 + 1) * hz_points[i] / (a_sample_rate / 2.0f)));
+std::vector<Ort::Value> AIManager::encode_chunks(std::vector<std::vector<float>> & features){
+    if(!a_encoder_batcher){
+        return run_encoder_batch(features);
     }
 
-    for(int i = 0; i < a_n_mel; ++i){
-        int left = bin_points[i];
-        int center = bin_points[i + 1];
-        int right = bin_points[i + 2];
-
-        for(int j = left; j < center; ++j){
-            filters[i][j] = static_cast<float>(j - left) / static_cast<float>(center - left);
-        }
-        
-        for(int j = center; j < right; ++j){
-            filters[i][j] = static_cast<float>(right - j) / static_cast<float>(right - center);
-        }
+    std::vector<std::future<Ort::Value>> pending;
+    for(auto & chunk_features : features){
+        pending.push_back(a_encoder_batcher->submit(std::move(chunk_features)));
     }
-
-    return filters;
+    std::vector<Ort::Value> encoder_outputs;
+    for(auto & encoder_output : pending){
+        encoder_outputs.push_back(encoder_output.get());
+    }
+    return encoder_outputs;
 }
 
-std::string AIManager::decode_and_transcribe(const Ort::Value & encoder_output){
-    Ort::SessionOptions session_options;
-    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+std::vector<Ort::Value> AIManager::run_encoder_batch(std::vector<std::vector<float>> & features){
+    Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator,OrtMemType::OrtMemTypeDefault);
+    std::vector<const char*> encoder_input_names = {"input_features"};
+    std::vector<const char*> encoder_output_names = {"last_hidden_state"};
 
-    std::vector<const char*> decoder_input_names = {"input_ids","encoder_hidden_states"};
-    std::vector<const char*> decoder_output_names = {"logits"};
+    std::vector<Ort::Value> encoder_outputs;
+    encoder_outputs.reserve(features.size());
+    for(size_t i = 0; i < features.size(); ++i){
+        encoder_outputs.emplace_back(nullptr);
+    }
 
-    //the token is general, so what's the main token?
-    std::vector<int64_t> input_ids {50257};
+    //one run per distinct length, the tensor is [B, 80, T]
+    std::vector<bool> done(features.size(), false);
+    for(size_t first = 0; first < features.size(); ++first){
+        if(done[first]){
+            continue;
+        }
+        std::vector<size_t> members;
+        for(size_t i = first; i < features.size(); ++i){
+            if(!done[i] && features[i].size() == features[first].size()){
+                members.push_back(i);
+                done[i] = true;
+            }
+        }
 
-    std::vector<int64_t> output_tokens;
-    const int64_t EOT_TOKEN = 50256;
-    const int MAX_LENGTH = 200;
+        const int64_t time_steps = static_cast<int64_t>(features[first].size() / a_n_mel);
+        std::vector<float> batch_features;
+        if(members.size() == 1){
+            batch_features = std::move(features[first]);
+        }else{
+            batch_features.reserve(features[first].size() * members.size());
+            for(size_t i : members){
+                batch_features.insert(batch_features.end(), features[i].begin(), features[i].end());
+            }
+        }
 
-    for(int i = 0; i < MAX_LENGTH; ++i){
-        //create input tensor
-        std::array<int64_t, 2> input_shape = {1, static_cast<long long>(input_ids.size())};
-        Ort::Value input_ids_tensor = Ort::Value::CreateTensor<int64_t>(
+        std::array<int64_t, 3> encoder_input_shape {static_cast<int64_t>(members.size()), a_n_mel, time_steps};
+        Ort::Value encoder_input_tensor = Ort::Value::CreateTensor<float>(
             memory_info,
-            input_ids.data(),
-            input_ids.size(),
-            input_shape.data(),
-            input_shape.size()
+            batch_features.data(),
+            batch_features.size(),
+            encoder_input_shape.data(),
+            encoder_input_shape.size()
         );
 
-        std::vector<Ort::Value> decoder_inputs;
-        decoder_inputs.push_back(std::move(input_ids_tensor));
-        decoder_inputs.push_back(std::move(const_cast<Ort::Value&>(encoder_output)));
-
-        auto decoder_outputs = a_decoder_session.Run(
+        auto outputs = a_encoder_session.Run(
             Ort::RunOptions{nullptr},
-            decoder_input_names.data(),
-            decoder_inputs.data(),
-            2,
-            decoder_output_names.data(),
+            encoder_input_names.data(),
+            &encoder_input_tensor,
+            1,
+            encoder_output_names.data(),
             1
         );
 
-        //get the highest token
-        float * logits = decoder_outputs[0].GetTensorMutableData<float>();
-
-        auto logits_shape = decoder_outputs[0].GetTensorTypeAndShapeInfo().GetShape();
-        int64_t vocab_size = logits_shape[2];
-        float * last_logits = logits + (logits_shape[1] - 1) * vocab_size;
+        //route each last_hidden_state row back to its chunk
+        if(members.size() == 1){
+            encoder_outputs[first] = std::move(outputs[0]);
+        }else{
+            for(size_t row = 0; row < members.size(); ++row){
+                encoder_outputs[members[row]] = AIvoice::WhisperDecoder::select_rows(outputs[0], {row});
+            }
+        }
+    }
 
-        int64_t next_token_index = std::distance(last_logits, std::max_element(last_logits, last_logits + vocab_size));
+    return encoder_outputs;
+}
 
-        output_tokens.push_back(next_token_index);
+namespace{
 
+    // a request body exposed to FFmpeg through a custom AVIOContext
+    struct MemoryInput{
+        const unsigned char * data;
+        size_t size;
+        size_t pos;
+    };
 
-        if(next_token_index == EOT_TOKEN){
-            break;
+    int read_memory_input(void * opaque, uint8_t * buf, int buf_size){
+        auto * input = static_cast<MemoryInput *>(opaque);
+        size_t remaining = input->size - input->pos;
+        if(remaining == 0){
+            return AVERROR_EOF;
         }
+        size_t count = std::min(remaining, static_cast<size_t>(buf_size));
+        std::memcpy(buf, input->data + input->pos, count);
+        input->pos += count;
+        return static_cast<int>(count);
+    }
 
-        input_ids.push_back(next_token_index);
+    int64_t seek_memory_input(void * opaque, int64_t offset, int whence){
+        auto * input = static_cast<MemoryInput *>(opaque);
+        if(whence & AVSEEK_SIZE){
+            return static_cast<int64_t>(input->size);
+        }
 
+        int64_t target;
+        switch(whence & ~AVSEEK_FORCE){
+            case SEEK_SET: target = offset; break;
+            case SEEK_CUR: target = static_cast<int64_t>(input->pos) + offset; break;
+            case SEEK_END: target = static_cast<int64_t>(input->size) + offset; break;
+            default: return AVERROR(EINVAL);
+        }
+        if(target < 0 || target > static_cast<int64_t>(input->size)){
+            return AVERROR(EINVAL);
+        }
+        input->pos = static_cast<size_t>(target);
+        return target;
     }
+}
 
-    std::string transcribed_text;
-    for(int64_t token_id : output_tokens){
-        auto it = a_whisper_vocab.find(token_id);
-        if(it != a_whisper_vocab.end()){
-            transcribed_text += it->second;
-        }else{
-            transcribed_text += "[UNK]";
-        }
+TranscriptionResult AIManager::transcribe_audio(const std::string & audio_file_path){
+    if(!a_audio_model_loaded){
+        return {"Error: Audio models not loaded.\n"};
     }
 
+    std::cout << "Starting audio transcription on: " << audio_file_path << std::endl;
 
-    return transcribed_text;
+    AVFormatContext * opened = nullptr;
+    //open the audio stream
+    if(avformat_open_input(&opened, audio_file_path.c_str(), nullptr, nullptr) < 0){
+        return {"Error: Could not open audio file.\n"};
+    }
+    AIvoice::FormatContextPtr fmt_ctx(opened);
+
+    //decoding runs on the pipeline's producer thread, which is joined before this returns
+    return transcribe_stream([this, &fmt_ctx](const PcmSink & sink){
+        return decode_audio(fmt_ctx.get(), sink);
+    });
 }
 
-std::string AIManager::transcribe_audio(const std::string & audio_file_path){
+TranscriptionResult AIManager::transcribe_audio(std::span<const unsigned char> audio_bytes, std::string_view content_type){
     if(!a_audio_model_loaded){
-        return "Error: Audio models not loaded.\n";
+        return {"Error: Audio models not loaded.\n"};
     }
 
-    std::cout << "Starting audio transcription on: " << audio_file_path << std::endl;
+    std::cout << "Starting audio transcription on " << audio_bytes.size() << " bytes in memory" << std::endl;
 
-    //1.use FFmpeg decode the audio to PCM floats
-    AVFormatContext * fmt_ctx = nullptr;
-    AVCodecContext * codec_ctx = nullptr;
-    AVPacket * pkt = av_packet_alloc();
-    AVFrame * frame = av_frame_alloc();
-    const AVCodec * codec = nullptr;
+    //uncompressed input is read in place, no probing and no codec
+    if(std::optional<AIvoice::PcmFormat> format = AIvoice::parse_pcm_content_type(content_type)){
+        size_t bytes = audio_bytes.size() - audio_bytes.size() % format->frame_bytes();
+        return transcribe_pcm_input({*format, audio_bytes.first(bytes)});
+    }
+    if(std::optional<AIvoice::PcmAudio> wav = AIvoice::parse_wav(audio_bytes)){
+        return transcribe_pcm_input(*wav);
+    }
 
-    //open the audio stream
-    if(avformat_open_input(&fmt_ctx, audio_file_path.c_str(), nullptr, nullptr) < 0){
-        return "Error: Could not open audio file.\n";
+    //demux straight from the request buffer
+    MemoryInput input{audio_bytes.data(), audio_bytes.size(), 0};
+    const int io_buffer_size = 64 * 1024;
+    unsigned char * io_buffer = static_cast<unsigned char *>(av_malloc(io_buffer_size));
+    if(!io_buffer){
+        return {"Error: Could not allocate audio io buffer.\n"};
+    }
+    AIvoice::IOContextPtr avio_ctx(avio_alloc_context(
+        io_buffer, io_buffer_size, 0, &input, &read_memory_input, nullptr, &seek_memory_input
+    ));
+    if(!avio_ctx){
+        av_free(io_buffer);
+        return {"Error: Could not allocate audio io context.\n"};
     }
+
+    AVFormatContext * opened = avformat_alloc_context();
+    if(!opened){
+        return {"Error: Could not allocate format context.\n"};
+    }
+    opened->pb = avio_ctx.get();
+    opened->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+    //avformat_open_input frees the context itself when it fails
+    if(avformat_open_input(&opened, nullptr, nullptr, nullptr) < 0){
+        return {"Error: Could not open audio data.\n"};
+    }
+    //closed before avio_ctx, which it reads through
+    AIvoice::FormatContextPtr fmt_ctx(opened);
+
+    return transcribe_stream([this, &fmt_ctx](const PcmSink & sink){
+        return decode_audio(fmt_ctx.get(), sink);
+    });
+}
+
+std::string AIManager::decode_audio(AVFormatContext * fmt_ctx, const PcmSink & sink){
+    //1.use FFmpeg decode the audio to PCM floats
+
     //find the audio stream
     if(avformat_find_stream_info(fmt_ctx,nullptr) < 0){
         return "Error: Could not find stream information.\n";
     }
 
-    int audio_stream_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+    int audio_stream_idx = av_find_best_stream(fmt_ctx, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
     if(audio_stream_idx < 0){
         return "Error: Could not find audio stream.\n";
     }
 
-    //open the decoder
-    codec_ctx = avcodec_alloc_context3(codec);
-    avcodec_parameters_to_context(codec_ctx, fmt_ctx->streams[audio_stream_idx]->codecpar);
-    if(avcodec_open2(codec_ctx, codec, nullptr) < 0){
+    //an opened decoder for this codec from the pool; returned, flushed, on every path out
+    AIvoice::DecoderPool::Lease decoder = a_decoder_pool.acquire(fmt_ctx->streams[audio_stream_idx]->codecpar);
+    if(!decoder){
         return "Error: Could not open codec.\n";
     }
+    AVCodecContext * codec_ctx = decoder.codec();
+    AVPacket * pkt = decoder.packet();
+    AVFrame * frame = decoder.frame();
+
+    //whatever the codec produces (s16, planar float, 44.1/48 kHz stereo...) becomes 16 kHz mono float
+    AIvoice::AudioResampler resampler(a_sample_rate);
+    std::vector<float> samples;
+    std::string error;
+    bool reading = true;
+    auto receive_frames = [&](){
+        while(reading && avcodec_receive_frame(codec_ctx, frame) >= 0){
+            if(!resampler.convert(frame, samples)){
+                error = "Error: Could not convert audio samples.\n";
+                reading = false;
+            }else if(!samples.empty()){
+                //the pipeline stopped, nothing more is needed
+                reading = sink(samples.data(), samples.size());
+            }
+            av_frame_unref(frame);
+        }
+    };
 
-    std::vector<float> pcm_data;
-    while(av_read_frame(fmt_ctx, pkt) >= 0){
+    while(reading && av_read_frame(fmt_ctx, pkt) >= 0){
         if(pkt->stream_index == audio_stream_idx){
             if(avcodec_send_packet(codec_ctx, pkt) >= 0){
-                while(avcodec_receive_frame(codec_ctx, frame) >= 0){
-                    //simple deal
-                    for(int i = 0; i < frame->nb_samples; ++i){
-                        pcm_data.push_back(static_cast<float>(reinterpret_cast<int16_t*>(frame->data[0])[i]) / 32768.0f);
-                    }
-                }
+                receive_frames();
             }
         }
         av_packet_unref(pkt);
     }
+
+    //frames the decoder and the resampler still hold
+    if(reading && avcodec_send_packet(codec_ctx, nullptr) >= 0){
+        receive_frames();
+    }
+    if(reading){
+        if(!resampler.flush(samples)){
+            error = "Error: Could not convert audio samples.\n";
+        }else if(!samples.empty()){
+            sink(samples.data(), samples.size());
+        }
+    }
+
+    return error;
+}
+
+TranscriptionResult AIManager::transcribe_pcm(const std::vector<float> & pcm_data){
+    return transcribe_stream([&pcm_data](const PcmSink & sink){
+        sink(pcm_data.data(), pcm_data.size());
+        return std::string();
+    });
+}
+
+TranscriptionResult AIManager::transcribe_pcm_input(const AIvoice::PcmAudio & audio){
+    return transcribe_stream([this, &audio](const PcmSink & sink){
+        //converted a block at a time, so only the request buffer holds the whole file
+        const size_t block_frames = 16384;
+        const size_t frame_bytes = audio.format.frame_bytes();
+        const size_t frames = audio.frames();
+        std::vector<float> block(block_frames);
+
+        //other rates go through the resampler, 16 kHz goes straight to the sink
+        std::unique_ptr<AIvoice::AudioResampler> resampler;
+        if(audio.format.sample_rate != a_sample_rate){
+            resampler = std::make_unique<AIvoice::AudioResampler>(a_sample_rate);
+        }
+        std::vector<float> resampled;
+
+        for(size_t first = 0; first < frames; first += block_frames){
+            size_t count = std::min(block_frames, frames - first);
+            AIvoice::pcm_to_mono_float(audio.format, audio.payload.data() + first * frame_bytes, count, block.data());
+            if(!resampler){
+                if(!sink(block.data(), count)){
+                    return std::string();
+                }
+                continue;
+            }
+            if(!resampler->convert(block.data(), static_cast<int>(count), audio.format.sample_rate, resampled)){
+                return std::string("Error: Could not convert audio samples.\n");
+            }
+            if(!resampled.empty() && !sink(resampled.data(), resampled.size())){
+                return std::string();
+            }
+        }
+        if(resampler){
+            if(!resampler->flush(resampled)){
+                return std::string("Error: Could not convert audio samples.\n");
+            }
+            if(!resampled.empty()){
+                sink(resampled.data(), resampled.size());
+            }
+        }
+        return std::string();
+    });
+}
+
+namespace{
+
+    // one planned chunk on its way from the producer to the encoder
+    struct ChunkFeatures{
+        std::vector<float> features;
+        size_t samples;
+        size_t input_samples;
+    };
+}
+
+TranscriptionResult AIManager::transcribe_stream(const std::function<std::string(const PcmSink &)> & source){
     //2.convert PCM to Mel Spectrogram
-    // const int sample_rate = 16000;
     //3.convert Mel to tensor
     //4.get the encoder's output
     //5.cal
 
-    std::string full_transcription;
-    const int chunk_sample_count = 240240;
-
-    for(size_t i = 0; i < pcm_data.size(); i += chunk_sample_count){
+    if(!a_audio_model_loaded){
+        return {"Error: Audio models not loaded.\n"};
+    }
 
+    const auto started = std::chrono::steady_clock::now();
+
+    //chunks in flight together: enough to fill an encoder batch, few enough to bound memory
+    const size_t window = a_encoder_batcher ? a_encoder_batcher->max_batch() : 1;
+    AIvoice::BoundedQueue<ChunkFeatures> chunk_queue(window);
+
+    //producer: decode, find the speech, cut chunks at pauses and compute their features.
+    //chunks end at pauses; with the VAD on only speech is planned, the silence between chunks is skipped
+    std::string source_error;
+    std::exception_ptr producer_error;
+    size_t total_samples = 0;
+    size_t speech_samples = 0;
+    std::thread producer([&](){
+        //one per STFT worker, reused for every chunk of the request
+        std::vector<AIvoice::MelFrontend::Workspace> mel_workspaces(std::max<size_t>(a_options.preprocess_threads, 1));
+        for(auto & workspace : mel_workspaces){
+            workspace = a_mel_frontend.make_workspace();
+        }
         std::vector<float> audio_chunk;
-        size_t end_pos = std::min(i + chunk_sample_count, pcm_data.size());
-        audio_chunk.assign(pcm_data.begin() + i, pcm_data.begin() + end_pos);
-
-        if(audio_chunk.size() < chunk_sample_count){
-            audio_chunk.resize(chunk_sample_count, 0.0f);
+        AIvoice::ChunkStream stream(a_chunk_planner, a_vad.get(), [&](const AIvoice::AudioChunk & chunk, const float * samples){
+            const size_t length = chunk.end - chunk.begin;
+            audio_chunk.assign(samples, samples + length);
+            audio_chunk.resize(encoder_input_samples(length), 0.0f);
+
+            const int time_steps = a_mel_frontend.time_steps(audio_chunk.size());
+            std::vector<float> mel_spectrogram_data(a_n_mel * time_steps, 0.0f);
+            a_mel_frontend.compute_parallel(audio_chunk.data(), audio_chunk.size(), mel_spectrogram_data.data(), mel_workspaces, a_preprocess_pool);
+            return chunk_queue.push({std::move(mel_spectrogram_data), length, audio_chunk.size()});
+        });
+
+        try{
+            source_error = source([&stream](const float * samples, size_t count){
+                return stream.append(samples, count);
+            });
+            if(source_error.empty()){
+                stream.finish();
+            }
+        }catch(...){
+            producer_error = std::current_exception();
         }
-
-        //6.decode round by round, and get a token
-        const int time_steps = (audio_chunk.size() - a_n_fft) / a_hop_length + 1;
-        std::vector<float> mel_spectrogram_data(a_n_mel * time_steps, 0.0f);
-    
-        auto mel_filters = create_mel_filter_bank();
-    
-    
-        std::vector<float> window(a_n_fft);
-        for(int i = 0; i < a_n_fft; ++i){
-            window[i] = 0.5f * (1.0f - std::cos(2.0f * M_PI * i / (a_n_fft - 1)));
+        total_samples = stream.total_samples();
+        speech_samples = stream.speech_samples();
+        chunk_queue.close();
+    });
+
+    //consumer: encode what is ready while earlier chunks are still decoding
+    TranscriptionResult result;
+    std::deque<DecodingWindow> decoding;
+    nlohmann::json chunk_reports = nlohmann::json::array();
+    //decoder buffers reused by every chunk of the request when there is no scheduler
+    AIvoice::WhisperDecoder::Workspace decoder_workspace;
+    size_t chunks = 0;
+    size_t planned_samples = 0;
+    size_t padded_samples = 0;
+    auto finish_oldest = [&](){
+        result.text += finish_decoding(decoding.front(), chunk_reports);
+        decoding.pop_front();
+        if(!result.report.contains("first_text_seconds")){
+            result.report["first_text_seconds"] = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
         }
-    
-        for(int i = 0; i < time_steps; ++i){
-            int start_pos = i * a_hop_length;
-            std::vector<float> frame_data(a_n_fft, 0.0f);
-    
-            for(int j = 0; j < a_n_fft; ++j){
-                frame_data[j] = audio_chunk[start_pos + j] * window[j];
+    };
+
+    try{
+        while(std::optional<ChunkFeatures> chunk = chunk_queue.pop()){
+            std::vector<std::vector<float>> features;
+            do{
+                ++chunks;
+                planned_samples += chunk->samples;
+                padded_samples += chunk->input_samples - chunk->samples;
+                features.push_back(std::move(chunk->features));
+            }while(features.size() < window && (chunk = chunk_queue.try_pop()));
+
+            //encoder runs are batched with the rest of the window and with other requests
+            //6.decode round by round, and get a token
+            decoding.push_back(start_decoding(encode_chunks(features), decoder_workspace));
+            //one window decodes while the next is encoded
+            while(decoding.size() > 1){
+                finish_oldest();
             }
-    
-            std::vector<float> fft_magnitude;
-            computeFFT(frame_data, fft_magnitude);
-            
-            for(int j = 0; j < a_n_mel; ++j){
-                float mel_sum = 0.0f;
-                for(int k = 0; k < fft_magnitude.size(); ++k){
-                    mel_sum += mel_filters[j][k] * fft_magnitude[k];
+        }
+        while(!decoding.empty()){
+            finish_oldest();
+        }
+    }catch(...){
+        chunk_queue.close();
+        producer.join();
+        //the scheduler reads the encoder outputs until each sequence is done
+        for(auto & pending : decoding){
+            for(auto & decoded : pending.results){
+                if(decoded.valid()){
+                    decoded.wait();
                 }
-                mel_spectrogram_data[j * time_steps + i] = std::log(mel_sum + 1e-6);
             }
         }
-    
-        std::array<int64_t, 3> encoder_input_shape {1, a_n_mel, static_cast<long long>(time_steps)};
-        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator,OrtMemType::OrtMemTypeDefault);
-    
-    
-        Ort::Value encoder_input_tensor = Ort::Value::CreateTensor<float>(
-            memory_info,
-            mel_spectrogram_data.data(),
-            mel_spectrogram_data.size(),
-            encoder_input_shape.data(),
-            encoder_input_shape.size()
-        );
-    
-        std::vector<const char*> encoder_input_names = {"input_features"};
-        std::vector<const char*> encoder_output_names = {"last_hidden_state"};
-    
-        auto encoder_outputs = a_encoder_session.Run(
-            Ort::RunOptions{nullptr},
-            encoder_input_names.data(),
-            &encoder_input_tensor,
-            1,
-            encoder_output_names.data(),
-            1 
-        );
+        throw;
+    }
+    producer.join();
 
+    if(producer_error){
+        std::rethrow_exception(producer_error);
+    }
+    if(!source_error.empty()){
+        return {source_error};
+    }
 
-        if(!encoder_outputs.empty()){
-            full_transcription += decode_and_transcribe(encoder_outputs[0]);
+    result.report["vad"] = a_vad ? a_vad->method() : "off";
+    result.report["audio_seconds"] = static_cast<double>(total_samples) / a_sample_rate;
+    result.report["speech_seconds"] = static_cast<double>(speech_samples) / a_sample_rate;
+    result.report["chunks"] = chunks;
+    result.report["skipped_seconds"] = static_cast<double>(total_samples - planned_samples) / a_sample_rate;
+    result.report["padded_seconds"] = static_cast<double>(padded_samples) / a_sample_rate;
+
+    //per chunk: why its decoding stopped, and the decoder steps it took
+    size_t decoder_steps = 0;
+    size_t decoded_tokens = 0;
+    size_t no_speech_chunks = 0;
+    for(const auto & chunk_report : chunk_reports){
+        decoder_steps += chunk_report["decoder_steps"].get<size_t>();
+        decoded_tokens += chunk_report["tokens"].get<size_t>();
+        if(chunk_report["stop"] == AIvoice::stop_reason_name(AIvoice::StopReason::no_speech)){
+            ++no_speech_chunks;
         }
     }
-
-
-    //free sources
-    av_packet_free(&pkt);
-    av_frame_free(&frame);
-    avcodec_free_context(&codec_ctx);
-    avformat_close_input(&fmt_ctx);
-
-    if(full_transcription.empty()){
-        //free sources
-        return "Error: Encoder output is Empty.\n";
+    result.report["decoder_steps"] = decoder_steps;
+    result.report["no_speech_chunks"] = no_speech_chunks;
+    result.report["decoding"] = std::move(chunk_reports);
+
+    //nothing but silence is an empty transcription, not an error; neither is
+    //a chunk that only decoded end of text or that the no-speech rule emptied
+    if(decoded_tokens == 0 && chunks > no_speech_chunks){
+        return {"Error: Encoder output is Empty.\n", std::move(result.report)};
     }
     //7.change the token to str
-    return full_transcription;
+    return result;
+}
+
+size_t AIManager::encoder_input_samples(size_t chunk_samples) const{
+    //a fixed-length encoder needs every chunk padded to the full window
+    const size_t max_samples = a_chunk_planner.max_samples();
+    if(!a_options.encoder_dynamic_length){
+        return max_samples;
+    }
+
+    //the audio plus a margin, rounded up to the bucket, never past the window
+    const size_t margin = static_cast<size_t>(a_options.encoder_length_margin_ms) * a_sample_rate / 1000;
+    const size_t bucket = std::max<size_t>(static_cast<size_t>(a_options.encoder_length_bucket_ms) * a_sample_rate / 1000, a_hop_length);
+    size_t samples = std::max(chunk_samples + margin, static_cast<size_t>(a_n_fft));
+    samples = (samples + bucket - 1) / bucket * bucket;
+    return std::min(samples, max_samples);
 }
 
 void AIManager::load_labels(const std::string & label_path){
@@ -400,13 +781,8 @@ void AIManager::load_image_model(const std::string & model_path){
         return;
     }
 
-    //create session options, and you can set the thread number;
-    Ort::SessionOptions session_options;
-
-    //create session
-    a_session = Ort::Session(a_env, model_path.c_str(), session_options);
-    
-    
+    //create session options, the thread numbers come from AIManagerOptions
+    Ort::SessionOptions session_options = make_session_options();
 
     try {
         a_session = Ort::Session(a_env, model_path.c_str(), session_options);
@@ -431,6 +807,23 @@ void AIManager::load_image_model(const std::string & model_path){
             std::cout << "Output Name " << i << ": " << output_name << std::endl;
         }
 
+        // a fixed leading dimension means the export only takes one image per run
+        AIvoice::MicroBatcherOptions batcher_options = a_options.image_batching;
+        auto input_shape = a_session.GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if(!input_shape.empty() && input_shape[0] > 0){
+            std::cout << "Image model has a fixed batch of " << input_shape[0] << ", not batching requests." << std::endl;
+            batcher_options.max_batch = 1;
+        }
+        a_image_run_batch = batcher_options.max_batch;
+        if(batcher_options.max_batch > 1){
+            a_image_batcher = std::make_unique<AIvoice::MicroBatcher<std::vector<float>, std::string>>(
+                [this](std::vector<std::vector<float>> & images){
+                    return run_image_batch(images);
+                },
+                batcher_options
+            );
+        }
+
     } catch (const Ort::Exception& e) {
         std::cerr << "ONNX Runtime Error: " << e.what() << std::endl;
         a_image_model_loaded = false;
@@ -455,10 +848,136 @@ std::string AIManager::run_image_inference(const std::string & image_file_path){
         return "Error: Could not load image.\n";
     }
 
-    //resize to 224 224
+    return classify_image(image_data, width, height);
+}
+
+std::string AIManager::run_image_inference(std::span<const unsigned char> image_bytes){
+    if(!a_image_model_loaded){
+        return "Error: Model not loaded.\n";
+    }
+
+    //1. decode the image from memory
+    int width, height, channels;
+    unsigned char * image_data = stbi_load_from_memory(
+        image_bytes.data(), static_cast<int>(image_bytes.size()), &width, &height, &channels, 3
+    );
+    if(!image_data){
+        return "Error: Could not load image.\n";
+    }
+
+    return classify_image(image_data, width, height);
+}
+
+void AIManager::run_image_inference(std::span<const unsigned char> image_bytes, ImageCompletion done){
+    auto ready = [](std::string result){
+        std::promise<std::string> promise;
+        promise.set_value(std::move(result));
+        return promise.get_future();
+    };
+    if(!a_image_model_loaded){
+        done(ready("Error: Model not loaded.\n"));
+        return;
+    }
+
+    //1. decode the image from memory
+    int width, height, channels;
+    unsigned char * image_data = stbi_load_from_memory(
+        image_bytes.data(), static_cast<int>(image_bytes.size()), &width, &height, &channels, 3
+    );
+    if(!image_data){
+        done(ready("Error: Could not load image.\n"));
+        return;
+    }
+
+    classify_image(image_data, width, height, std::move(done));
+}
+
+std::vector<std::string> AIManager::run_image_inference(const std::vector<std::span<const unsigned char>> & images){
+    if(!a_image_model_loaded){
+        return std::vector<std::string>(images.size(), "Error: Model not loaded.\n");
+    }
+
+    //1. decode and preprocess every image, spread over a few threads
+    std::vector<std::string> results(images.size());
+    std::vector<std::vector<float>> tensors(images.size());
+    AIvoice::parallel_for(a_preprocess_pool, images.size(), a_options.preprocess_threads, [&](size_t, size_t begin, size_t end){
+        for(size_t i = begin; i < end; ++i){
+            int width, height, channels;
+            unsigned char * image_data = stbi_load_from_memory(
+                images[i].data(), static_cast<int>(images[i].size()), &width, &height, &channels, 3
+            );
+            if(!image_data){
+                results[i] = "Error: Could not load image.\n";
+                continue;
+            }
+            tensors[i] = preprocess_image(image_data, width, height);
+        }
+    });
+
+    std::vector<size_t> decoded;
+    for(size_t i = 0; i < images.size(); ++i){
+        if(results[i].empty()){
+            decoded.push_back(i);
+        }
+    }
+
+    //2. run the decoded ones, a_image_run_batch at a time
+    for(size_t start = 0; start < decoded.size(); start += a_image_run_batch){
+        size_t end = std::min(start + a_image_run_batch, decoded.size());
+        std::vector<std::vector<float>> batch;
+        batch.reserve(end - start);
+        for(size_t k = start; k < end; ++k){
+            batch.push_back(std::move(tensors[decoded[k]]));
+        }
+
+        std::vector<std::string> batch_results = run_image_batch(batch);
+        for(size_t k = start; k < end; ++k){
+            results[decoded[k]] = std::move(batch_results[k - start]);
+        }
+    }
+
+    return results;
+}
+
+std::string AIManager::classify_image(unsigned char * image_data, int width, int height){
+    std::vector<float> input_tensor_values = preprocess_image(image_data, width, height);
+
+    //3. run the a_session, batched together with whatever else is in flight
+    if(a_image_batcher){
+        return a_image_batcher->submit(std::move(input_tensor_values)).get();
+    }
+
+    std::vector<std::vector<float>> batch;
+    batch.push_back(std::move(input_tensor_values));
+    return run_image_batch(batch).front();
+}
+
+void AIManager::classify_image(unsigned char * image_data, int width, int height, ImageCompletion done){
+    std::vector<float> input_tensor_values = preprocess_image(image_data, width, height);
+
+    //3. queue it for the a_session, the batcher completes it with its batch
+    if(a_image_batcher){
+        a_image_batcher->submit(std::move(input_tensor_values), std::move(done));
+        return;
+    }
+
+    std::promise<std::string> result;
+    try{
+        std::vector<std::vector<float>> batch;
+        batch.push_back(std::move(input_tensor_values));
+        result.set_value(run_image_batch(batch).front());
+    }catch(...){
+        result.set_exception(std::current_exception());
+    }
+    done(result.get_future());
+}
+
+std::vector<float> AIManager::preprocess_image(unsigned char * image_data, int width, int height){
+    //resize to 224 224, stbi already expanded everything to 3 channels
     const int target_width = 224;
     const int target_height = 224;
-    std::vector<unsigned char> resize_image(target_width * target_width * channels);
+    const int channels = 3;
+    std::vector<unsigned char> resize_image(target_width * target_height * channels);
     stbir_resize_uint8(image_data, width, height, 0, resize_image.data(), target_width, target_height, 0, channels);
     stbi_image_free(image_data);
 
@@ -480,9 +999,27 @@ std::string AIManager::run_image_inference(const std::string & image_file_path){
         }
     }
 
+    return input_tensor_values;
+}
+
+std::vector<std::string> AIManager::run_image_batch(std::vector<std::vector<float>> & images){
+    const int target_width = 224;
+    const int target_height = 224;
+    const size_t image_size = 3 * target_height * target_width;
+    const int64_t batch_size = static_cast<int64_t>(images.size());
+
+    // mobilenetv2 -> [N, 3, H, W]
+    std::vector<float> input_tensor_values;
+    if(batch_size == 1){
+        input_tensor_values = std::move(images.front());
+    }else{
+        input_tensor_values.resize(image_size * batch_size);
+        for(int64_t n = 0; n < batch_size; ++n){
+            std::copy(images[n].begin(), images[n].end(), input_tensor_values.begin() + n * image_size);
+        }
+    }
 
-    //free
-    std::array<int64_t, 4> input_shape {1,3,target_height,target_width};
+    std::array<int64_t, 4> input_shape {batch_size,3,target_height,target_width};
     Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
     Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
         memory_info,
@@ -491,8 +1028,7 @@ std::string AIManager::run_image_inference(const std::string & image_file_path){
         input_shape.data(),
         input_shape.size()
     );
-    
-    //3. run the a_session
+
     std::vector<const char*> input_names {"data"};
     std::vector<const char*> output_names {"mobilenetv20_output_flatten0_reshape0"};
 
@@ -506,20 +1042,40 @@ std::string AIManager::run_image_inference(const std::string & image_file_path){
     );
 
 
-    //4. parse the output tensor
-    float * output_data = output_tensors.front().GetTensorMutableData<float>();
-    //5. change the tensor to string and return
-    std::vector<float> output_values(output_data, output_data + 1000);
-    auto max_it = std::max_element(output_values.begin(), output_values.end());
-    int max_index = std::distance(output_values.begin(), max_it);
+    //4. parse the output tensor, one [1000] row per image
+    const float * output_data = output_tensors.front().GetTensorMutableData<float>();
+    const int64_t num_classes = output_tensors.front().GetTensorTypeAndShapeInfo().GetShape().back();
 
+    std::vector<std::string> results;
+    results.reserve(batch_size);
+    for(int64_t n = 0; n < batch_size; ++n){
+        const float * row = output_data + n * num_classes;
+        const float * max_it = std::max_element(row, row + num_classes);
+        int max_index = std::distance(row, max_it);
 
-    //convert to labels
-    std::string predicted_label = "Unknown";
-    if(max_index >= 0 && max_index < a_labels.size()){
-        predicted_label = a_labels[max_index];
+        //convert to labels
+        std::string predicted_label = "Unknown";
+        if(max_index >= 0 && max_index < a_labels.size()){
+            predicted_label = a_labels[max_index];
+        }
+
+        //5. change the tensor to string
+        results.push_back("Predicted class index : " + predicted_label + ", socre" + std::to_string(*max_it));
     }
+    return results;
+}
 
-    // return "Inference result: placeholder";
-    return "Predicted class index : " + predicted_label + ", socre" + std::to_string(*max_it); 
-}
\ No newline at end of file
+nlohmann::json AIManager::stats() const{
+    nlohmann::json res_json;
+    if(a_image_batcher){
+        res_json["image_batcher"] = a_image_batcher->stats();
+    }
+    if(a_encoder_batcher){
+        res_json["encoder_batcher"] = a_encoder_batcher->stats();
+    }
+    if(a_decoder_scheduler){
+        res_json["decoder_scheduler"] = a_decoder_scheduler->stats();
+    }
+    res_json["audio_decoder_pool"] = a_decoder_pool.stats();
+    return res_json;
+}
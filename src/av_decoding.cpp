@@ -0,0 +1,208 @@
+//file:: av_decoding.cpp
+#include "include/av_decoding.hpp"
+
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+    #include <libavutil/avutil.h>
+}
+
+
+namespace AIvoice{
+
+    namespace{
+
+        template<typename T>
+        void append_bytes(std::string & key, const T & value){
+            key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+        }
+
+        // a pooled decoder is only reused for a stream it would have been opened for
+        std::string decoder_key(const AVCodecParameters * parameters){
+            std::string key;
+            append_bytes(key, parameters->codec_id);
+            append_bytes(key, parameters->format);
+            append_bytes(key, parameters->sample_rate);
+            append_bytes(key, parameters->ch_layout.nb_channels);
+            append_bytes(key, parameters->block_align);
+            append_bytes(key, parameters->bits_per_coded_sample);
+            if(parameters->extradata && parameters->extradata_size > 0){
+                key.append(reinterpret_cast<const char *>(parameters->extradata), parameters->extradata_size);
+            }
+            return key;
+        }
+    }
+
+    void FormatContextDeleter::operator()(AVFormatContext * context) const{
+        avformat_close_input(&context);
+    }
+
+    void IOContextDeleter::operator()(AVIOContext * context) const{
+        av_freep(&context->buffer);
+        avio_context_free(&context);
+    }
+
+    void CodecContextDeleter::operator()(AVCodecContext * context) const{
+        avcodec_free_context(&context);
+    }
+
+    void PacketDeleter::operator()(AVPacket * packet) const{
+        av_packet_free(&packet);
+    }
+
+    void FrameDeleter::operator()(AVFrame * frame) const{
+        av_frame_free(&frame);
+    }
+
+    DecoderPool::Lease::Lease(Lease && other) noexcept
+    : pool(other.pool), key(std::move(other.key)), codec_context(std::move(other.codec_context)),
+    packet_ptr(std::move(other.packet_ptr)), frame_ptr(std::move(other.frame_ptr))
+    {
+        other.pool = nullptr;
+    }
+
+    DecoderPool::Lease & DecoderPool::Lease::operator=(Lease && other) noexcept{
+        if(this != &other){
+            if(pool){
+                pool->release(*this);
+            }
+            pool = other.pool;
+            key = std::move(other.key);
+            codec_context = std::move(other.codec_context);
+            packet_ptr = std::move(other.packet_ptr);
+            frame_ptr = std::move(other.frame_ptr);
+            other.pool = nullptr;
+        }
+        return *this;
+    }
+
+    DecoderPool::Lease::~Lease(){
+        if(pool){
+            pool->release(*this);
+        }
+    }
+
+    AVCodecContext * DecoderPool::Lease::codec() const{
+        return codec_context.get();
+    }
+
+    AVPacket * DecoderPool::Lease::packet() const{
+        return packet_ptr.get();
+    }
+
+    AVFrame * DecoderPool::Lease::frame() const{
+        return frame_ptr.get();
+    }
+
+    DecoderPool::Lease::operator bool() const{
+        return codec_context && packet_ptr && frame_ptr;
+    }
+
+    DecoderPool::DecoderPool(std::size_t max_idle, int threads)
+    : dp_max_idle(max_idle), dp_threads(threads), dp_opened(0), dp_reused(0)
+    {
+    }
+
+    DecoderPool::Lease DecoderPool::acquire(const AVCodecParameters * parameters){
+        Lease lease;
+        lease.pool = this;
+        lease.key = decoder_key(parameters);
+
+        {
+            std::lock_guard<std::mutex> lock(dp_mutex);
+            for(auto it = dp_idle_codecs.rbegin(); it != dp_idle_codecs.rend(); ++it){
+                if(it->key == lease.key){
+                    lease.codec_context = std::move(it->codec);
+                    dp_idle_codecs.erase(std::next(it).base());
+                    ++dp_reused;
+                    break;
+                }
+            }
+            if(!dp_idle_buffers.empty()){
+                lease.packet_ptr = std::move(dp_idle_buffers.back().first);
+                lease.frame_ptr = std::move(dp_idle_buffers.back().second);
+                dp_idle_buffers.pop_back();
+            }
+        }
+
+        if(!lease.codec_context){
+            const AVCodec * codec = avcodec_find_decoder(parameters->codec_id);
+            if(!codec){
+                return Lease();
+            }
+            CodecContextPtr context(avcodec_alloc_context3(codec));
+            if(!context || avcodec_parameters_to_context(context.get(), parameters) < 0){
+                return Lease();
+            }
+            context->thread_count = dp_threads;
+            context->thread_type = 0;
+            if(codec->capabilities & AV_CODEC_CAP_FRAME_THREADS){
+                context->thread_type |= FF_THREAD_FRAME;
+            }
+            if(codec->capabilities & AV_CODEC_CAP_SLICE_THREADS){
+                context->thread_type |= FF_THREAD_SLICE;
+            }
+            if(avcodec_open2(context.get(), codec, nullptr) < 0){
+                return Lease();
+            }
+            lease.codec_context = std::move(context);
+
+            std::lock_guard<std::mutex> lock(dp_mutex);
+            ++dp_opened;
+        }
+
+        if(!lease.packet_ptr){
+            lease.packet_ptr.reset(av_packet_alloc());
+            lease.frame_ptr.reset(av_frame_alloc());
+            if(!lease.packet_ptr || !lease.frame_ptr){
+                return Lease();
+            }
+        }
+        return lease;
+    }
+
+    void DecoderPool::release(Lease & lease){
+        lease.pool = nullptr;
+        // a drained or half-read decoder starts over on its next stream
+        if(lease.codec_context){
+            avcodec_flush_buffers(lease.codec_context.get());
+        }
+        if(lease.packet_ptr){
+            av_packet_unref(lease.packet_ptr.get());
+        }
+        if(lease.frame_ptr){
+            av_frame_unref(lease.frame_ptr.get());
+        }
+
+        // evicted entries are freed after the lock is dropped
+        Idle evicted_codec;
+        std::pair<PacketPtr, FramePtr> evicted_buffers;
+        {
+            std::lock_guard<std::mutex> lock(dp_mutex);
+            if(lease.codec_context){
+                dp_idle_codecs.push_back({std::move(lease.key), std::move(lease.codec_context)});
+                if(dp_idle_codecs.size() > dp_max_idle){
+                    evicted_codec = std::move(dp_idle_codecs.front());
+                    dp_idle_codecs.erase(dp_idle_codecs.begin());
+                }
+            }
+            if(lease.packet_ptr && lease.frame_ptr){
+                dp_idle_buffers.emplace_back(std::move(lease.packet_ptr), std::move(lease.frame_ptr));
+                if(dp_idle_buffers.size() > dp_max_idle){
+                    evicted_buffers = std::move(dp_idle_buffers.front());
+                    dp_idle_buffers.erase(dp_idle_buffers.begin());
+                }
+            }
+        }
+    }
+
+    nlohmann::json DecoderPool::stats() const{
+        std::lock_guard<std::mutex> lock(dp_mutex);
+        nlohmann::json res_json;
+        res_json["max_idle"] = dp_max_idle;
+        res_json["opened"] = dp_opened;
+        res_json["reused"] = dp_reused;
+        res_json["idle"] = dp_idle_codecs.size();
+        return res_json;
+    }
+}
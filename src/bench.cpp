@@ -0,0 +1,431 @@
+//file:: bench.cpp
+#include "include/bench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "include/ai_manager.hpp"
+#include "include/fft.hpp"
+#include "include/logits_processor.hpp"
+#include "include/mel_frontend.hpp"
+#include "include/whisper_decoder.hpp"
+
+
+namespace AIvoice{
+
+    namespace{
+
+        // the O(N^2) DFT AIManager::computeFFT used before RealFFT, kept as the reference
+        void naive_dft_magnitude(const std::vector<float> & input, std::vector<float> & output_magnitude){
+            int N = input.size();
+            std::vector<std::complex<float>> X(N);
+            for(int k = 0; k < N / 2; ++k){
+                std::complex<float> sum(0.0f, 0.0f);
+                for(int n = 0; n < N; ++n){
+                    float angle = -2.0f * M_PI * k * n / N;
+                    sum += input[n] * std::complex<float>(std::cos(angle), std::sin(angle));
+                }
+                X[k] = sum;
+            }
+
+            output_magnitude.resize(N / 2 + 1);
+            for(int i = 0; i < N / 2 + 1; ++i){
+                output_magnitude[i] = std::abs(X[i]);
+            }
+        }
+
+        std::vector<std::vector<float>> make_frames(std::size_t n, std::size_t count){
+            std::mt19937 rng(42);
+            std::uniform_real_distribution<float> sample(-1.0f, 1.0f);
+            std::vector<std::vector<float>> frames(count, std::vector<float>(n));
+            for(auto & frame : frames){
+                for(std::size_t i = 0; i < n; ++i){
+                    // hann windowed noise, like the STFT frames in transcribe_pcm
+                    frame[i] = sample(rng) * 0.5f * (1.0f - std::cos(2.0f * M_PI * i / (n - 1)));
+                }
+            }
+            return frames;
+        }
+
+        // one chunk worth of frames through the old DFT and through RealFFT
+        int bench_fft(){
+            const std::size_t frames_per_chunk = 1500;
+
+            for(std::size_t n : {400, 512}){
+                auto frames = make_frames(n, frames_per_chunk);
+                std::vector<std::vector<float>> reference(frames.size());
+                std::vector<std::vector<float>> result(frames.size(), std::vector<float>(n / 2 + 1));
+
+                auto start = std::chrono::steady_clock::now();
+                for(std::size_t f = 0; f < frames.size(); ++f){
+                    naive_dft_magnitude(frames[f], reference[f]);
+                }
+                double naive_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                RealFFT fft(n);
+                RealFFT::Workspace workspace = fft.make_workspace();
+                const int repeats = 20;
+                start = std::chrono::steady_clock::now();
+                for(int r = 0; r < repeats; ++r){
+                    for(std::size_t f = 0; f < frames.size(); ++f){
+                        fft.magnitude(frames[f].data(), result[f].data(), workspace);
+                    }
+                }
+                double fft_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+                // the old loop never filled the Nyquist bin, so compare below it
+                float max_error = 0.0f;
+                for(std::size_t f = 0; f < frames.size(); ++f){
+                    for(std::size_t k = 0; k < n / 2; ++k){
+                        max_error = std::max(max_error, std::fabs(reference[f][k] - result[f][k]));
+                    }
+                }
+
+                std::cout << "fft n=" << n << ", " << frames_per_chunk << " frames: "
+                          << "naive dft " << naive_ms << " ms, real fft " << fft_ms << " ms, "
+                          << "speedup " << naive_ms / fft_ms << "x, max abs error " << max_error << std::endl;
+            }
+            return EXIT_SUCCESS;
+        }
+
+        // a few harmonics under a slow envelope, enough to give the encoder non-trivial input
+        std::vector<float> make_test_audio(std::size_t count, int sample_rate){
+            std::vector<float> audio(count);
+            for(std::size_t i = 0; i < count; ++i){
+                float t = static_cast<float>(i) / sample_rate;
+                float envelope = 0.5f * (1.0f - std::cos(2.0f * M_PI * 0.5f * t));
+                audio[i] = envelope * (0.3f * std::sin(2.0f * M_PI * 220.0f * t)
+                                     + 0.2f * std::sin(2.0f * M_PI * 440.0f * t)
+                                     + 0.1f * std::sin(2.0f * M_PI * 880.0f * t));
+            }
+            return audio;
+        }
+
+        // one 15 s chunk of log-mel features on one thread and split across workers
+        int bench_mel(){
+            const int sample_rate = 16000;
+            MelFrontend mel(sample_rate, 400, 160, 80);
+            std::vector<float> audio = make_test_audio(240240, sample_rate);
+            const int time_steps = mel.time_steps(audio.size());
+            const std::size_t size = static_cast<std::size_t>(mel.n_mel()) * time_steps;
+            const int repeats = 20;
+
+            std::vector<float> reference(size);
+            MelFrontend::Workspace workspace = mel.make_workspace();
+            mel.compute(audio.data(), audio.size(), reference.data(), workspace);
+            auto start = std::chrono::steady_clock::now();
+            for(int r = 0; r < repeats; ++r){
+                mel.compute(audio.data(), audio.size(), reference.data(), workspace);
+            }
+            double serial_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+            std::cout << "mel " << time_steps << " frames: 1 thread " << serial_ms << " ms" << std::endl;
+
+            const std::size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+            for(std::size_t workers = 2; workers <= hardware && workers <= 16; workers *= 2){
+                WorkerPool pool(workers - 1);
+                std::vector<MelFrontend::Workspace> workspaces(workers);
+                for(auto & w : workspaces){
+                    w = mel.make_workspace();
+                }
+                std::vector<float> result(size);
+                mel.compute_parallel(audio.data(), audio.size(), result.data(), workspaces, pool);
+                start = std::chrono::steady_clock::now();
+                for(int r = 0; r < repeats; ++r){
+                    mel.compute_parallel(audio.data(), audio.size(), result.data(), workspaces, pool);
+                }
+                double parallel_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repeats;
+
+                float max_error = 0.0f;
+                for(std::size_t i = 0; i < size; ++i){
+                    max_error = std::max(max_error, std::fabs(reference[i] - result[i]));
+                }
+                std::cout << "mel " << time_steps << " frames: " << workers << " threads " << parallel_ms << " ms, "
+                          << "speedup " << serial_ms / parallel_ms << "x, max abs error " << max_error << std::endl;
+            }
+            return EXIT_SUCCESS;
+        }
+
+        // Whisper-sized logits rows through every kernel this CPU has, against the
+        // separate passes they replace: mask, argmax, log-softmax and no-speech softmax
+        int bench_logits(){
+            const int64_t vocab_size = 51865;
+            const int64_t eot = 50256;
+            const int rows = 256;
+            const int repeats = 20;
+
+            std::vector<int64_t> suppressed;
+            for(int64_t id = eot + 1; id < vocab_size; ++id){
+                suppressed.push_back(id);
+            }
+            const std::vector<int64_t> suppressed_at_begin = {220, eot};
+            const int64_t no_speech_token = 50362;
+            LogitsProcessor processor(vocab_size, suppressed, suppressed_at_begin, no_speech_token);
+
+            std::mt19937 rng(7);
+            std::normal_distribution<float> distribution(0.0f, 4.0f);
+            std::vector<float> logits(static_cast<std::size_t>(rows) * vocab_size);
+            for(auto & value : logits){
+                value = distribution(rng);
+            }
+
+            std::vector<TokenChoice> reference(rows);
+            std::vector<float> masked(vocab_size);
+            auto start = std::chrono::steady_clock::now();
+            for(int r = 0; r < repeats; ++r){
+                for(int row = 0; row < rows; ++row){
+                    const float * row_logits = logits.data() + static_cast<int64_t>(row) * vocab_size;
+                    std::copy_n(row_logits, vocab_size, masked.data());
+                    for(int64_t id : suppressed){
+                        masked[id] = -std::numeric_limits<float>::infinity();
+                    }
+                    const auto best = std::max_element(masked.begin(), masked.end());
+                    float sum = 0.0f;
+                    for(float value : masked){
+                        sum += std::exp(value - *best);
+                    }
+                    const float raw_max = *std::max_element(row_logits, row_logits + vocab_size);
+                    float raw_sum = 0.0f;
+                    for(int64_t id = 0; id < vocab_size; ++id){
+                        raw_sum += std::exp(row_logits[id] - raw_max);
+                    }
+                    volatile float no_speech_prob = std::exp(row_logits[no_speech_token] - raw_max) / raw_sum;
+                    (void)no_speech_prob;
+                    reference[row] = TokenChoice{std::distance(masked.begin(), best), -std::log(sum)};
+                }
+            }
+            double passes_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (repeats * rows);
+            std::cout << "logits " << vocab_size << " vocab: separate passes " << passes_us << " us/row" << std::endl;
+
+            for(auto kernel : {LogitsProcessor::Kernel::scalar, LogitsProcessor::Kernel::avx2, LogitsProcessor::Kernel::avx512}){
+                if(!LogitsProcessor::supported(kernel)){
+                    std::cout << "logits " << LogitsProcessor::name(kernel) << ": not supported on this CPU" << std::endl;
+                    continue;
+                }
+                processor.set_kernel(kernel);
+
+                std::vector<TokenChoice> choices(rows);
+                float no_speech_prob = 0.0f;
+                start = std::chrono::steady_clock::now();
+                for(int r = 0; r < repeats; ++r){
+                    for(int row = 0; row < rows; ++row){
+                        choices[row] = processor.choose(logits.data() + static_cast<int64_t>(row) * vocab_size, vocab_size, false, SamplingOptions(), 0.0f, &no_speech_prob);
+                    }
+                }
+                double kernel_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / (repeats * rows);
+
+                int mismatches = 0;
+                float max_error = 0.0f;
+                for(int row = 0; row < rows; ++row){
+                    mismatches += choices[row].token != reference[row].token;
+                    max_error = std::max(max_error, std::fabs(choices[row].logprob - reference[row].logprob));
+                }
+                std::cout << "logits " << LogitsProcessor::name(kernel) << ": " << kernel_us << " us/row, speedup "
+                          << passes_us / kernel_us << "x, " << mismatches << " token mismatches, max logprob error " << max_error << std::endl;
+            }
+            return EXIT_SUCCESS;
+        }
+
+        Ort::SessionOptions bench_session_options(const ServerConfig & config){
+            Ort::SessionOptions session_options;
+            if(config.ai.intra_op_threads > 0){
+                session_options.SetIntraOpNumThreads(config.ai.intra_op_threads);
+            }
+            if(config.ai.inter_op_threads > 0){
+                session_options.SetInterOpNumThreads(config.ai.inter_op_threads);
+            }
+            return session_options;
+        }
+
+        // one chunk decoded for a fixed number of steps, rerunning the prefix vs the KV cache
+        int bench_decoder(const ServerConfig & config){
+            try{
+                Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "AIvoice-bench");
+                Ort::SessionOptions session_options = bench_session_options(config);
+                Ort::Session encoder(env, config.encoder_model_path.c_str(), session_options);
+                Ort::Session decoder(env, config.decoder_model_path.c_str(), session_options);
+                Ort::Session decoder_with_past(env, config.decoder_with_past_model_path.c_str(), session_options);
+
+                WhisperDecoder whisper(decoder, &decoder_with_past);
+                if(!whisper.uses_cache()){
+                    std::cerr << "decoder bench needs a matching --decoder-with-past-model" << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                const int sample_rate = 16000;
+                MelFrontend mel(sample_rate, 400, 160, 80);
+                std::vector<float> audio = make_test_audio(240240, sample_rate);
+                const int time_steps = mel.time_steps(audio.size());
+                std::vector<float> features(static_cast<std::size_t>(mel.n_mel()) * time_steps);
+                MelFrontend::Workspace workspace = mel.make_workspace();
+                mel.compute(audio.data(), audio.size(), features.data(), workspace);
+
+                Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+                std::array<int64_t, 3> feature_shape = {1, mel.n_mel(), time_steps};
+                Ort::Value feature_tensor = Ort::Value::CreateTensor<float>(
+                    memory_info, features.data(), features.size(), feature_shape.data(), feature_shape.size()
+                );
+                const char * encoder_input_names[] = {"input_features"};
+                const char * encoder_output_names[] = {"last_hidden_state"};
+                auto encoder_outputs = encoder.Run(Ort::RunOptions{nullptr}, encoder_input_names, &feature_tensor, 1, encoder_output_names, 1);
+                const Ort::Value & hidden_states = encoder_outputs[0];
+
+                // sot and notimestamps of the English-only vocabulary, as transcriptions
+                // start. eot -1: both loops run every step, whatever the synthetic audio decodes to
+                const std::vector<int64_t> prompt = {50257, 50362};
+                whisper.greedy_full(hidden_states, prompt, -1, 4);
+                whisper.greedy(hidden_states, prompt, -1, 4);
+
+                for(int steps : {50, 200}){
+                    auto start = std::chrono::steady_clock::now();
+                    std::vector<int64_t> full_tokens = whisper.greedy_full(hidden_states, prompt, -1, steps);
+                    double full_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                    start = std::chrono::steady_clock::now();
+                    std::vector<int64_t> cached_tokens = whisper.greedy(hidden_states, prompt, -1, steps);
+                    double cached_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                    std::size_t agree = 0;
+                    while(agree < full_tokens.size() && agree < cached_tokens.size() && full_tokens[agree] == cached_tokens[agree]){
+                        ++agree;
+                    }
+
+                    std::cout << "decoder " << steps << " steps: "
+                              << "full prefix " << full_ms << " ms (" << full_ms / steps << " ms/token), "
+                              << "kv cache " << cached_ms << " ms (" << cached_ms / steps << " ms/token), "
+                              << "speedup " << full_ms / cached_ms << "x, "
+                              << "tokens agree " << agree << "/" << full_tokens.size() << std::endl;
+                }
+            }catch(const Ort::Exception & e){
+                std::cerr << "decoder bench failed: " << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+
+        // characters to insert, delete or replace to turn a into b
+        std::size_t edit_distance(const std::string & a, const std::string & b){
+            std::vector<std::size_t> row(b.size() + 1);
+            for(std::size_t j = 0; j <= b.size(); ++j){
+                row[j] = j;
+            }
+            for(std::size_t i = 1; i <= a.size(); ++i){
+                std::size_t diagonal = row[0];
+                row[0] = i;
+                for(std::size_t j = 1; j <= b.size(); ++j){
+                    std::size_t above = row[j];
+                    row[j] = std::min({row[j] + 1, row[j - 1] + 1, diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+                    diagonal = above;
+                }
+            }
+            return row[b.size()];
+        }
+
+        // the same clips padded to the full 15 s window and trimmed to their length.
+        // needs an encoder exported with a dynamic frame axis
+        int bench_encoder_length(const ServerConfig & config){
+            // one chunk per run on both sides, so only the input length differs
+            AIManagerOptions full_options = config.ai;
+            full_options.encoder_dynamic_length = false;
+            full_options.encoder_batching.max_batch = 1;
+            full_options.decoder_batching.max_batch = 1;
+            AIManagerOptions trimmed_options = full_options;
+            trimmed_options.encoder_dynamic_length = true;
+
+            AIManager full(full_options);
+            AIManager trimmed(trimmed_options);
+            full.load_audio_model(config.encoder_model_path, config.decoder_model_path, config.decoder_with_past_model_path);
+            trimmed.load_audio_model(config.encoder_model_path, config.decoder_model_path, config.decoder_with_past_model_path);
+
+            struct Clip{
+                std::string name;
+                std::string path;
+                std::vector<float> samples;
+            };
+            std::vector<Clip> clips;
+            if(config.bench_audio.empty()){
+                for(int seconds : {1, 2, 3, 5}){
+                    clips.push_back({"synthetic " + std::to_string(seconds) + " s", "", make_test_audio(static_cast<std::size_t>(seconds) * 16000, 16000)});
+                }
+            }else{
+                std::istringstream paths(config.bench_audio);
+                std::string path;
+                while(std::getline(paths, path, ',')){
+                    if(!path.empty()){
+                        clips.push_back({path, path, {}});
+                    }
+                }
+            }
+
+            auto transcribe = [](AIManager & manager, const Clip & clip){
+                return clip.path.empty() ? manager.transcribe_pcm(clip.samples) : manager.transcribe_audio(clip.path);
+            };
+
+            // warm up both sessions so the first clip does not pay for allocation
+            for(AIManager * manager : {&full, &trimmed}){
+                TranscriptionResult warmup = transcribe(*manager, clips.front());
+                if(warmup.text.rfind("Error", 0) == 0){
+                    std::cerr << "encoder-length bench failed: " << warmup.text;
+                    return EXIT_FAILURE;
+                }
+            }
+
+            for(const auto & clip : clips){
+                auto start = std::chrono::steady_clock::now();
+                TranscriptionResult full_result = transcribe(full, clip);
+                double full_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                start = std::chrono::steady_clock::now();
+                TranscriptionResult trimmed_result = transcribe(trimmed, clip);
+                double trimmed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                if(trimmed_result.text.rfind("Error", 0) == 0){
+                    std::cerr << clip.name << ": " << trimmed_result.text;
+                    continue;
+                }
+
+                // character agreement with the full-window transcript, 1 means identical
+                std::size_t longest = std::max(full_result.text.size(), trimmed_result.text.size());
+                double agreement = longest == 0 ? 1.0 : 1.0 - static_cast<double>(edit_distance(full_result.text, trimmed_result.text)) / longest;
+
+                std::cout << "encoder-length " << clip.name << ": "
+                          << "full window " << full_ms << " ms, trimmed " << trimmed_ms << " ms, "
+                          << "speedup " << full_ms / trimmed_ms << "x, "
+                          << "padding " << full_result.report.value("padded_seconds", 0.0) << " s -> "
+                          << trimmed_result.report.value("padded_seconds", 0.0) << " s, "
+                          << "text agreement " << agreement << std::endl;
+            }
+            return EXIT_SUCCESS;
+        }
+    }
+
+    int run_benchmark(const std::string & name, const ServerConfig & config){
+        if(name == "fft"){
+            return bench_fft();
+        }
+        if(name == "mel"){
+            return bench_mel();
+        }
+        if(name == "decoder"){
+            return bench_decoder(config);
+        }
+        if(name == "logits"){
+            return bench_logits();
+        }
+        if(name == "encoder-length"){
+            return bench_encoder_length(config);
+        }
+
+        std::cerr << "unknown benchmark '" << name << "', available: fft, mel, decoder, logits, encoder-length" << std::endl;
+        return EXIT_FAILURE;
+    }
+}
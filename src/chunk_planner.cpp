@@ -0,0 +1,113 @@
+//file:: chunk_planner.cpp
+#include "include/chunk_planner.hpp"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        // 10 ms energy frames, compared over a sliding 50 ms
+        const std::size_t energy_frame = 160;
+        const std::size_t pause_frames = 5;
+    }
+
+    ChunkPlanner::ChunkPlanner(const ChunkPlannerOptions & options)
+    : p_options(options)
+    {
+        if(p_options.max_samples < 2 * energy_frame * pause_frames){
+            p_options.max_samples = 2 * energy_frame * pause_frames;
+        }
+        // the split always lands in the second half of a window, so chunks make progress
+        p_options.search_samples = std::min(p_options.search_samples, p_options.max_samples / 2);
+    }
+
+    std::size_t ChunkPlanner::max_samples() const{
+        return p_options.max_samples;
+    }
+
+    std::vector<AudioChunk> ChunkPlanner::plan(const float * samples, std::size_t count) const{
+        if(count == 0){
+            return {};
+        }
+        return plan(samples, count, {SpeechRegion{0, count}});
+    }
+
+    std::vector<AudioChunk> ChunkPlanner::plan(const float * samples, std::size_t count, const std::vector<SpeechRegion> & regions) const{
+        const std::size_t max_samples = p_options.max_samples;
+        std::vector<AudioChunk> chunks;
+        bool open = false;
+        AudioChunk current{0, 0};
+
+        for(const auto & region : regions){
+            std::size_t begin = region.begin;
+            const std::size_t end = std::min(region.end, count);
+
+            while(begin < end){
+                // the rest of the region still fits behind the open chunk
+                if(open && end - current.begin <= max_samples){
+                    current.end = end;
+                    break;
+                }
+                // otherwise the pause before this region ends the open chunk
+                if(open){
+                    chunks.push_back(current);
+                    open = false;
+                }
+
+                if(end - begin <= max_samples){
+                    current = {begin, end};
+                    open = true;
+                    break;
+                }
+
+                std::size_t window_end = begin + max_samples;
+                std::size_t split = find_pause(samples, window_end - p_options.search_samples, window_end);
+                chunks.push_back({begin, split});
+                begin = split;
+            }
+        }
+
+        if(open){
+            chunks.push_back(current);
+        }
+        return chunks;
+    }
+
+    std::size_t ChunkPlanner::find_pause(const float * samples, std::size_t from, std::size_t to) const{
+        const std::size_t frames = (to - from) / energy_frame;
+        if(frames < pause_frames){
+            return to;
+        }
+
+        std::vector<float> energy(frames);
+        for(std::size_t f = 0; f < frames; ++f){
+            const float * frame = samples + from + f * energy_frame;
+            float sum = 0.0f;
+            for(std::size_t i = 0; i < energy_frame; ++i){
+                sum += frame[i] * frame[i];
+            }
+            energy[f] = sum;
+        }
+
+        // ties go to the later window, so chunks stay as long as possible
+        float window_energy = 0.0f;
+        for(std::size_t f = 0; f < pause_frames; ++f){
+            window_energy += energy[f];
+        }
+        float best_energy = window_energy;
+        std::size_t best_start = 0;
+        for(std::size_t f = pause_frames; f < frames; ++f){
+            window_energy += energy[f] - energy[f - pause_frames];
+            if(window_energy <= best_energy){
+                best_energy = window_energy;
+                best_start = f - pause_frames + 1;
+            }
+        }
+
+        // the middle of the quietest window
+        return from + (best_start * energy_frame) + (pause_frames * energy_frame) / 2;
+    }
+}
@@ -0,0 +1,95 @@
+//file:: chunk_stream.cpp
+#include "include/chunk_stream.hpp"
+
+#include <algorithm>
+
+
+namespace AIvoice{
+
+    ChunkStream::ChunkStream(const ChunkPlanner & planner, const VoiceActivityDetector * vad, ChunkSink on_chunk)
+    : cs_planner(planner), cs_vad(vad), cs_on_chunk(std::move(on_chunk)),
+    cs_window(3 * planner.max_samples()), cs_base(0), cs_speech_samples(0), cs_stopped(false)
+    {
+        cs_buffer.reserve(cs_window);
+    }
+
+    bool ChunkStream::append(const float * samples, std::size_t count){
+        while(count > 0 && !cs_stopped){
+            std::size_t take = std::min(count, cs_window - cs_buffer.size());
+            cs_buffer.insert(cs_buffer.end(), samples, samples + take);
+            samples += take;
+            count -= take;
+            if(cs_buffer.size() == cs_window){
+                process(false);
+            }
+        }
+        return !cs_stopped;
+    }
+
+    bool ChunkStream::finish(){
+        if(!cs_stopped && !cs_buffer.empty()){
+            process(true);
+        }
+        return !cs_stopped;
+    }
+
+    std::size_t ChunkStream::total_samples() const{
+        return cs_base + cs_buffer.size();
+    }
+
+    std::size_t ChunkStream::speech_samples() const{
+        return cs_speech_samples;
+    }
+
+    bool ChunkStream::process(bool final){
+        const float * samples = cs_buffer.data();
+        const std::size_t count = cs_buffer.size();
+
+        std::vector<SpeechRegion> regions;
+        std::vector<AudioChunk> chunks;
+        if(cs_vad){
+            regions = cs_vad->detect(samples, count);
+            chunks = cs_planner.plan(samples, count, regions);
+        }else{
+            chunks = cs_planner.plan(samples, count);
+        }
+
+        // a chunk is at most max_samples long, so one starting before `limit`
+        // cannot have been cut short by the end of the buffer
+        const std::size_t limit = final ? count : count - cs_planner.max_samples();
+        std::size_t cut = final ? count : limit;
+        bool emitted = false;
+        for(const auto & chunk : chunks){
+            if(chunk.begin >= limit){
+                break;
+            }
+            AudioChunk absolute{cs_base + chunk.begin, cs_base + chunk.end};
+            if(!cs_on_chunk(absolute, samples + chunk.begin)){
+                cs_stopped = true;
+                return false;
+            }
+            if(!final){
+                cut = chunk.end;
+            }
+            emitted = true;
+        }
+        // no speech starts before `limit`, the silence up to it is done with
+        if(!emitted && !final){
+            cut = limit;
+        }
+
+        if(cs_vad){
+            for(const auto & region : regions){
+                if(region.begin < cut){
+                    cs_speech_samples += std::min(region.end, cut) - region.begin;
+                }
+            }
+        }else{
+            cs_speech_samples += cut;
+        }
+
+        cs_buffer.erase(cs_buffer.begin(), cs_buffer.begin() + cut);
+        cs_base += cut;
+        return true;
+    }
+}
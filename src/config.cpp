@@ -0,0 +1,303 @@
+//file:: config.cpp
+#include "include/config.hpp"
+
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        struct Option{
+            std::string name;
+            std::string help;
+            std::function<void(ServerConfig &, const std::string &)> apply;
+        };
+
+        long long parse_integer(const std::string & name, const std::string & value, long long min_value){
+            std::size_t used = 0;
+            long long result = 0;
+            try{
+                result = std::stoll(value, &used);
+            }catch(const std::exception &){
+                used = 0;
+            }
+            if(used == 0 || used != value.size() || result < min_value){
+                throw std::invalid_argument("--" + name + " expects an integer >= " + std::to_string(min_value) + ", got '" + value + "'");
+            }
+            return result;
+        }
+
+        unsigned int parse_port(const std::string & name, const std::string & value){
+            const long long port = parse_integer(name, value, 0);
+            if(port > 65535){
+                throw std::invalid_argument("--" + name + " expects a port between 0 and 65535, got '" + value + "'");
+            }
+            return static_cast<unsigned int>(port);
+        }
+
+        double parse_number(const std::string & name, const std::string & value){
+            std::size_t used = 0;
+            double result = 0.0;
+            try{
+                result = std::stod(value, &used);
+            }catch(const std::exception &){
+                used = 0;
+            }
+            if(used == 0 || used != value.size()){
+                throw std::invalid_argument("--" + name + " expects a number, got '" + value + "'");
+            }
+            return result;
+        }
+
+        bool parse_bool(const std::string & name, const std::string & value){
+            if(value == "true" || value == "1" || value == "on"){
+                return true;
+            }
+            if(value == "false" || value == "0" || value == "off"){
+                return false;
+            }
+            throw std::invalid_argument("--" + name + " expects true or false, got '" + value + "'");
+        }
+
+        // comma separated ids, also as a json array from the config file
+        std::vector<int64_t> parse_token_list(const std::string & name, std::string value){
+            if(value.size() >= 2 && value.front() == '[' && value.back() == ']'){
+                value = value.substr(1, value.size() - 2);
+            }
+            std::vector<int64_t> tokens;
+            std::stringstream stream(value);
+            std::string item;
+            while(std::getline(stream, item, ',')){
+                item.erase(0, item.find_first_not_of(' '));
+                item.erase(item.find_last_not_of(' ') + 1);
+                if(!item.empty()){
+                    tokens.push_back(parse_integer(name, item, 0));
+                }
+            }
+            return tokens;
+        }
+
+        // comma separated numbers >= 0, also as a json array from the config file
+        std::vector<float> parse_number_list(const std::string & name, std::string value){
+            if(value.size() >= 2 && value.front() == '[' && value.back() == ']'){
+                value = value.substr(1, value.size() - 2);
+            }
+            std::vector<float> numbers;
+            std::stringstream stream(value);
+            std::string item;
+            while(std::getline(stream, item, ',')){
+                item.erase(0, item.find_first_not_of(' '));
+                item.erase(item.find_last_not_of(' ') + 1);
+                if(item.empty()){
+                    continue;
+                }
+                const double number = parse_number(name, item);
+                if(number < 0.0){
+                    throw std::invalid_argument("--" + name + " expects numbers >= 0, got '" + item + "'");
+                }
+                numbers.push_back(static_cast<float>(number));
+            }
+            return numbers;
+        }
+
+        const std::vector<Option> & options(){
+            static const std::vector<Option> table{
+                {"host", "address to listen on (localhost = all ipv4)",
+                    [](ServerConfig & c, const std::string & v){ c.host = v; }},
+                {"port", "port to listen on",
+                    [](ServerConfig & c, const std::string & v){ c.port = parse_port("port", v); }},
+                {"io-threads", "threads running the io_context",
+                    [](ServerConfig & c, const std::string & v){ c.io_threads = static_cast<int>(parse_integer("io-threads", v, 1)); }},
+                {"compute-threads", "threads running model inference",
+                    [](ServerConfig & c, const std::string & v){ c.compute_threads = parse_integer("compute-threads", v, 1); }},
+                {"queue-depth", "inference jobs allowed to wait before answering 503",
+                    [](ServerConfig & c, const std::string & v){ c.queue_depth = parse_integer("queue-depth", v, 0); }},
+                {"ort-intra-threads", "onnxruntime intra-op threads per session (0 = onnxruntime default)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.intra_op_threads = static_cast<int>(parse_integer("ort-intra-threads", v, 0)); }},
+                {"ort-inter-threads", "onnxruntime inter-op threads per session (0 = onnxruntime default)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.inter_op_threads = static_cast<int>(parse_integer("ort-inter-threads", v, 0)); }},
+                {"preprocess-threads", "threads one request may use for decode and feature extraction, helpers shared by all requests",
+                    [](ServerConfig & c, const std::string & v){ c.ai.preprocess_threads = parse_integer("preprocess-threads", v, 1); }},
+                {"audio-decoder-pool", "opened audio decoders kept between requests (0 = open one per request)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.audio_decoder_pool = parse_integer("audio-decoder-pool", v, 0); }},
+                {"image-max-batch", "most /upload images classified in one run (1 = no batching)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.image_batching.max_batch = parse_integer("image-max-batch", v, 1); }},
+                {"image-batch-wait-us", "microseconds an image may wait for others to batch with",
+                    [](ServerConfig & c, const std::string & v){ c.ai.image_batching.max_wait = std::chrono::microseconds(parse_integer("image-batch-wait-us", v, 0)); }},
+                {"encoder-max-batch", "most audio chunks encoded in one Whisper encoder run, across requests (1 = no batching)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.encoder_batching.max_batch = parse_integer("encoder-max-batch", v, 1); }},
+                {"encoder-batch-wait-us", "microseconds a chunk may wait for others to encode with",
+                    [](ServerConfig & c, const std::string & v){ c.ai.encoder_batching.max_wait = std::chrono::microseconds(parse_integer("encoder-batch-wait-us", v, 0)); }},
+                {"decoder-max-batch", "most sequences sharing one Whisper decoder step, across requests (1 = no batching)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decoder_batching.max_batch = parse_integer("decoder-max-batch", v, 1); }},
+                {"decoder-batch-wait-us", "microseconds an idle decoder scheduler waits for more sequences to start with",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decoder_batching.max_wait = std::chrono::microseconds(parse_integer("decoder-batch-wait-us", v, 0)); }},
+                {"suppress-tokens", "comma separated token ids never decoded, on top of the special and timestamp tokens",
+                    [](ServerConfig & c, const std::string & v){ c.ai.suppress_tokens = parse_token_list("suppress-tokens", v); }},
+                {"suppress-blank", "a chunk's first token cannot be a blank or end of text (true/false)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.suppress_blank = parse_bool("suppress-blank", v); }},
+                {"decode-ngram-size", "tokens per n-gram of the repetition check (0 = off)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decode_guard.ngram_size = static_cast<int>(parse_integer("decode-ngram-size", v, 0)); }},
+                {"decode-ngram-repeats", "occurrences of the same n-gram that stop a chunk's decoding",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decode_guard.max_ngram_repeats = static_cast<int>(parse_integer("decode-ngram-repeats", v, 2)); }},
+                {"decode-compression-ratio", "tokens per LZ77 phrase that stop a chunk's decoding (0 = off, the default)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decode_guard.max_compression_ratio = static_cast<float>(parse_number("decode-compression-ratio", v)); }},
+                {"decode-logprob-threshold", "average token logprob below which a chunk's decoding stops for its next fallback temperature (0 = off)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decode_guard.min_avg_logprob = static_cast<float>(parse_number("decode-logprob-threshold", v)); }},
+                {"decode-min-tokens", "tokens decoded before the compression and logprob checks apply",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decode_guard.min_tokens = static_cast<int>(parse_integer("decode-min-tokens", v, 1)); }},
+                {"no-speech-threshold", "no-speech probability at a chunk's first decoder step above which it is left without text when its average logprob is also below --decode-logprob-threshold (1 = off)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decode_guard.no_speech_threshold = static_cast<float>(parse_number("no-speech-threshold", v)); }},
+                {"decode-fallback-temperatures", "comma separated sampling temperatures to retry a chunk at after an early stop (empty = no retries)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.decode_guard.fallback_temperatures = parse_number_list("decode-fallback-temperatures", v); }},
+                {"vad", "skip audio chunks without speech before the encoder (true/false)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.vad.enabled = parse_bool("vad", v); }},
+                {"vad-model", "Silero VAD onnx model (empty = energy/spectral detector)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.vad.model_path = v; }},
+                {"vad-margin-db", "dB above the noise floor a frame needs to count as speech",
+                    [](ServerConfig & c, const std::string & v){ c.ai.vad.margin_db = static_cast<float>(parse_number("vad-margin-db", v)); }},
+                {"vad-threshold", "speech probability threshold of --vad-model",
+                    [](ServerConfig & c, const std::string & v){ c.ai.vad.model_threshold = static_cast<float>(parse_number("vad-threshold", v)); }},
+                {"chunk-search-ms", "window before each 15 s chunk end searched for a pause to split at",
+                    [](ServerConfig & c, const std::string & v){ c.ai.chunking.search_samples = parse_integer("chunk-search-ms", v, 0) * 16; }},
+                {"encoder-dynamic-length", "the encoder accepts shorter inputs, do not pad chunks to 15 s (true/false)",
+                    [](ServerConfig & c, const std::string & v){ c.ai.encoder_dynamic_length = parse_bool("encoder-dynamic-length", v); }},
+                {"encoder-length-margin-ms", "with --encoder-dynamic-length, audio kept after a chunk's end",
+                    [](ServerConfig & c, const std::string & v){ c.ai.encoder_length_margin_ms = static_cast<int>(parse_integer("encoder-length-margin-ms", v, 0)); }},
+                {"encoder-length-bucket-ms", "with --encoder-dynamic-length, encoder inputs are rounded up to a multiple of this, so similar chunks batch",
+                    [](ServerConfig & c, const std::string & v){ c.ai.encoder_length_bucket_ms = static_cast<int>(parse_integer("encoder-length-bucket-ms", v, 10)); }},
+                {"image-model", "MobileNetV2 onnx model",
+                    [](ServerConfig & c, const std::string & v){ c.image_model_path = v; }},
+                {"encoder-model", "Whisper encoder onnx model",
+                    [](ServerConfig & c, const std::string & v){ c.encoder_model_path = v; }},
+                {"decoder-model", "Whisper decoder onnx model",
+                    [](ServerConfig & c, const std::string & v){ c.decoder_model_path = v; }},
+                {"decoder-with-past-model", "Whisper decoder_with_past onnx model for KV-cached decoding (empty = off)",
+                    [](ServerConfig & c, const std::string & v){ c.decoder_with_past_model_path = v; }},
+                {"labels", "ImageNet labels file",
+                    [](ServerConfig & c, const std::string & v){ c.ai.labels_path = v; }},
+                {"vocab", "Whisper tokenizer json",
+                    [](ServerConfig & c, const std::string & v){ c.ai.vocab_path = v; }},
+                {"persist-uploads", "also write uploads to --upload-dir (true/false)",
+                    [](ServerConfig & c, const std::string & v){ c.persist_uploads = parse_bool("persist-uploads", v); }},
+                {"upload-dir", "directory for persisted uploads",
+                    [](ServerConfig & c, const std::string & v){ c.upload_dir = v; }},
+                {"idle-timeout", "seconds a keep-alive connection may wait for its next request",
+                    [](ServerConfig & c, const std::string & v){ c.session.idle_timeout = std::chrono::seconds(parse_integer("idle-timeout", v, 1)); }},
+                {"read-timeout", "seconds allowed to receive a request body",
+                    [](ServerConfig & c, const std::string & v){ c.session.read_timeout = std::chrono::seconds(parse_integer("read-timeout", v, 1)); }},
+                {"write-timeout", "seconds allowed to send a response",
+                    [](ServerConfig & c, const std::string & v){ c.session.write_timeout = std::chrono::seconds(parse_integer("write-timeout", v, 1)); }},
+                {"body-limit", "largest accepted request body in bytes",
+                    [](ServerConfig & c, const std::string & v){ c.session.body_limit = parse_integer("body-limit", v, 1); }},
+                {"pipeline-limit", "requests read ahead of their responses per connection",
+                    [](ServerConfig & c, const std::string & v){ c.session.pipeline_limit = parse_integer("pipeline-limit", v, 1); }},
+            };
+            return table;
+        }
+
+        const Option & find_option(const std::string & name){
+            for(const auto & option : options()){
+                if(option.name == name){
+                    return option;
+                }
+            }
+            throw std::invalid_argument("unknown option --" + name);
+        }
+
+        // the json file uses the flag names as keys, e.g. {"io-threads": 8}
+        void apply_config_file(ServerConfig & config, const std::string & path){
+            std::ifstream infile(path);
+            if(!infile.is_open()){
+                throw std::invalid_argument("could not open config file: " + path);
+            }
+
+            nlohmann::json config_json;
+            try{
+                infile >> config_json;
+            }catch(const nlohmann::json::exception & e){
+                throw std::invalid_argument("could not parse config file " + path + ": " + e.what());
+            }
+            if(!config_json.is_object()){
+                throw std::invalid_argument("config file " + path + " must hold a json object");
+            }
+
+            for(const auto & item : config_json.items()){
+                const Option & option = find_option(item.key());
+                if(item.value().is_string()){
+                    option.apply(config, item.value().get<std::string>());
+                }else{
+                    option.apply(config, item.value().dump());
+                }
+            }
+        }
+    }
+
+    ServerConfig parse_config(int argc, char ** argv){
+        ServerConfig config;
+
+        std::vector<std::pair<std::string, std::string>> flags;
+        std::string config_path;
+
+        for(int i = 1; i < argc; ++i){
+            std::string arg = argv[i];
+            if(arg == "-h" || arg == "--help"){
+                config.show_help = true;
+                continue;
+            }
+            if(arg.rfind("--", 0) != 0){
+                throw std::invalid_argument("unexpected argument '" + arg + "'");
+            }
+
+            std::string name = arg.substr(2);
+            std::string value;
+            auto eq = name.find('=');
+            if(eq != std::string::npos){
+                value = name.substr(eq + 1);
+                name = name.substr(0, eq);
+            }else if(i + 1 < argc){
+                value = argv[++i];
+            }else{
+                throw std::invalid_argument("--" + name + " expects a value");
+            }
+
+            if(name == "config"){
+                config_path = value;
+            }else if(name == "bench"){
+                config.bench = value;
+            }else if(name == "bench-audio"){
+                config.bench_audio = value;
+            }else{
+                find_option(name);
+                flags.emplace_back(std::move(name), std::move(value));
+            }
+        }
+
+        if(!config_path.empty()){
+            apply_config_file(config, config_path);
+        }
+        for(const auto & [name, value] : flags){
+            find_option(name).apply(config, value);
+        }
+
+        return config;
+    }
+
+    std::string usage(const std::string & program){
+        std::ostringstream out;
+        out << "usage: " << program << " [--config file.json] [--option value ...]\n\n";
+        out << "  --config <path>\n      json object keyed by the option names below, flags override it\n";
+        out << "  --bench <name>\n      run a microbenchmark (fft, mel, decoder, logits, encoder-length) instead of the server\n";
+        out << "  --bench-audio <path,path,...>\n      audio files for the encoder-length benchmark (default: synthetic clips)\n";
+        for(const auto & option : options()){
+            out << "  --" << option.name << " <value>\n      " << option.help << "\n";
+        }
+        return out.str();
+    }
+}
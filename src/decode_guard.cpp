@@ -0,0 +1,176 @@
+//file:: decode_guard.cpp
+#include "include/decode_guard.hpp"
+
+#include <algorithm>
+
+
+namespace AIvoice{
+
+    const char * stop_reason_name(StopReason reason){
+        switch(reason){
+            case StopReason::eot: return "eot";
+            case StopReason::max_length: return "max_length";
+            case StopReason::repetition: return "repetition";
+            case StopReason::compression_ratio: return "compression_ratio";
+            case StopReason::low_logprob: return "low_logprob";
+            case StopReason::no_speech: return "no_speech";
+        }
+        return "unknown";
+    }
+
+    bool DecodeResult::stopped_early() const{
+        return stop_reason == StopReason::repetition || stop_reason == StopReason::compression_ratio || stop_reason == StopReason::low_logprob;
+    }
+
+    DecodeGuard::DecodeGuard(const DecodeGuardOptions & options, int64_t eot, int max_length, int attempt)
+    : g_options(options), g_eot(eot), g_max_length(max_length),
+    g_retry_left(static_cast<std::size_t>(std::max(attempt, 0)) < options.fallback_temperatures.size()), g_stop_reason(StopReason::max_length),
+    g_logprob_sum(0.0), g_no_speech_prob(0.0f), g_keep(0), g_phrases(0), g_phrase_start(0)
+    {
+        g_candidates.reserve(std::max(max_length, 0));
+    }
+
+    bool DecodeGuard::push(std::span<const int64_t> generated, float logprob, float no_speech_prob){
+        const std::size_t length = generated.size();
+        if(length == 1){
+            g_no_speech_prob = no_speech_prob;
+        }
+        g_logprob_sum += logprob;
+        g_keep = length;
+        extend_phrase(generated);
+
+        if(generated.back() == g_eot){
+            g_stop_reason = StopReason::eot;
+            return true;
+        }
+        if(std::ptrdiff_t start = repeat_start(generated); start >= 0){
+            g_stop_reason = StopReason::repetition;
+            g_keep = static_cast<std::size_t>(start);
+            return true;
+        }
+        if(length >= static_cast<std::size_t>(std::max(g_options.min_tokens, 1))){
+            if(g_options.max_compression_ratio > 0.0f && compression_ratio(length) > g_options.max_compression_ratio){
+                g_stop_reason = StopReason::compression_ratio;
+                return true;
+            }
+            //without a retry the text of a low-confidence chunk beats none
+            if(g_retry_left && g_options.min_avg_logprob < 0.0f && g_logprob_sum / length < g_options.min_avg_logprob){
+                g_stop_reason = StopReason::low_logprob;
+                return true;
+            }
+        }
+        if(length >= static_cast<std::size_t>(std::max(g_max_length, 0))){
+            g_stop_reason = StopReason::max_length;
+            return true;
+        }
+        return false;
+    }
+
+    StopReason DecodeGuard::stop_reason() const{
+        return g_stop_reason;
+    }
+
+    DecodeResult DecodeGuard::result(std::vector<int64_t> generated, float temperature) const{
+        DecodeResult result;
+        const std::size_t length = generated.size();
+        result.stop_reason = g_stop_reason;
+        result.avg_logprob = length > 0 ? static_cast<float>(g_logprob_sum / length) : 0.0f;
+        std::size_t keep = std::min(g_keep, length);
+        if(length > 0 && no_speech(result.avg_logprob)){
+            //silence the model still wrote something for; none of it is kept
+            result.stop_reason = StopReason::no_speech;
+            keep = 0;
+        }
+        result.compression_ratio = compression_ratio(length);
+        result.no_speech_prob = g_no_speech_prob;
+        result.temperature = temperature;
+        result.attempts = 1;
+        result.steps = static_cast<int>(length);
+        generated.resize(keep);
+        result.tokens = std::move(generated);
+        return result;
+    }
+
+    void DecodeGuard::extend_phrase(std::span<const int64_t> generated){
+        const std::size_t newest = generated.size() - 1;
+        const int64_t token = generated[newest];
+
+        if(newest == g_phrase_start){
+            //a new phrase may copy from anywhere before it
+            g_candidates.clear();
+            for(std::size_t i = 0; i < newest; ++i){
+                if(generated[i] == token){
+                    g_candidates.push_back(i);
+                }
+            }
+        }else{
+            //copies may run into the phrase itself, candidate + offset is always before newest
+            const std::size_t offset = newest - g_phrase_start;
+            g_candidates.erase(
+                std::remove_if(g_candidates.begin(), g_candidates.end(), [&](std::size_t candidate){ return generated[candidate + offset] != token; }),
+                g_candidates.end()
+            );
+        }
+
+        //no earlier copy: the phrase ends with this token as its literal
+        if(g_candidates.empty()){
+            ++g_phrases;
+            g_phrase_start = generated.size();
+        }
+    }
+
+    std::ptrdiff_t DecodeGuard::repeat_start(std::span<const int64_t> generated) const{
+        const std::size_t size = static_cast<std::size_t>(std::max(g_options.ngram_size, 0));
+        const int repeats = g_options.max_ngram_repeats;
+        if(size == 0 || repeats <= 1 || generated.size() < size * 2){
+            return -1;
+        }
+
+        //back from the newest occurrence; once `repeats` are found, the text up
+        //to the occurrence after the oldest keeps one copy of the loop
+        const std::span<const int64_t> last = generated.last(size);
+        const std::size_t newest = generated.size() - size;
+        std::size_t after_oldest = newest;
+        int count = 1;
+        for(std::size_t i = newest; i-- > 0;){
+            if(generated[i] == last[0] && std::equal(last.begin(), last.end(), generated.begin() + i)){
+                if(++count >= repeats){
+                    return static_cast<std::ptrdiff_t>(after_oldest);
+                }
+                after_oldest = i;
+            }
+        }
+        return -1;
+    }
+
+    float DecodeGuard::compression_ratio(std::size_t length) const{
+        const std::size_t phrases = g_phrases + (g_phrase_start < length ? 1 : 0);
+        return phrases > 0 ? static_cast<float>(length) / phrases : 1.0f;
+    }
+
+    bool DecodeGuard::no_speech(float avg_logprob) const{
+        if(g_options.no_speech_threshold >= 1.0f || g_no_speech_prob <= g_options.no_speech_threshold){
+            return false;
+        }
+        //confident tokens keep their text whatever the no-speech probability
+        return g_options.min_avg_logprob >= 0.0f || avg_logprob < g_options.min_avg_logprob;
+    }
+
+    float next_fallback_temperature(const DecodeGuardOptions & options, const DecodeResult & result){
+        const std::size_t retry = static_cast<std::size_t>(std::max(result.attempts - 1, 0));
+        if(!result.stopped_early() || retry >= options.fallback_temperatures.size()){
+            return -1.0f;
+        }
+        return options.fallback_temperatures[retry];
+    }
+
+    DecodeResult merge_attempts(DecodeResult previous, DecodeResult next){
+        const int attempts = previous.attempts + next.attempts;
+        const int steps = previous.steps + next.steps;
+        const bool keep_next = !next.stopped_early() || (previous.stopped_early() && next.avg_logprob > previous.avg_logprob);
+        DecodeResult kept = keep_next ? std::move(next) : std::move(previous);
+        kept.attempts = attempts;
+        kept.steps = steps;
+        return kept;
+    }
+}
@@ -0,0 +1,337 @@
+//file:: decoder_scheduler.cpp
+#include "include/decoder_scheduler.hpp"
+
+#include <algorithm>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        // idle workspaces kept for the next cohorts; a burst's extra ones are freed
+        constexpr std::size_t spare_workspaces = 2;
+
+        std::vector<int64_t> encoder_shape_of(const Ort::Value & encoder_output){
+            std::vector<int64_t> shape = encoder_output.GetTensorTypeAndShapeInfo().GetShape();
+            return std::vector<int64_t>(shape.begin() + 1, shape.end());
+        }
+    }
+
+    DecoderScheduler::DecoderScheduler(const WhisperDecoder & decoder, const DecoderSchedulerOptions & options)
+    : ds_decoder(decoder), ds_options(sanitize(options)), ds_stopping(false),
+    ds_batch_sizes({1, 2, 4, 8, 16, 32, 64}),
+    ds_wait_us({100, 250, 500, 1000, 2000, 5000, 10000, 50000}),
+    ds_worker([this](){ loop(); })
+    {
+    }
+
+    DecoderScheduler::~DecoderScheduler(){
+        {
+            std::lock_guard<std::mutex> lock(ds_mutex);
+            ds_stopping = true;
+        }
+        ds_cv.notify_all();
+        ds_worker.join();
+    }
+
+    DecoderSchedulerOptions DecoderScheduler::sanitize(DecoderSchedulerOptions options){
+        if(options.max_batch == 0){
+            options.max_batch = 1;
+        }
+        return options;
+    }
+
+    std::future<DecodeResult> DecoderScheduler::submit(const Ort::Value & encoder_output, std::vector<int64_t> prompt, int64_t eot, int max_length, const DecodeGuardOptions & guard){
+        Sequence sequence{
+            &encoder_output, std::move(prompt), 0, eot, max_length, guard, DecodeGuard(guard, eot, max_length),
+            0.0f, std::nullopt, false, {}, std::chrono::steady_clock::now()
+        };
+        sequence.prompt_length = sequence.tokens.size();
+        //tokens never grow while the sequence steps
+        sequence.tokens.reserve(sequence.prompt_length + std::max(max_length, 0));
+        std::future<DecodeResult> result = sequence.promise.get_future();
+
+        if(max_length <= 0){
+            sequence.promise.set_value(DecodeResult());
+            return result;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(ds_mutex);
+            ds_queue.push_back(std::move(sequence));
+        }
+        ds_cv.notify_one();
+        return result;
+    }
+
+    nlohmann::json DecoderScheduler::stats() const{
+        nlohmann::json res_json;
+        res_json["max_batch"] = ds_options.max_batch;
+        res_json["max_wait_us"] = ds_options.max_wait.count();
+        res_json["kv_cache"] = ds_decoder.uses_cache();
+        res_json["batch_size"] = ds_batch_sizes.to_json();
+        res_json["wait_us"] = ds_wait_us.to_json();
+        return res_json;
+    }
+
+    void DecoderScheduler::loop(){
+        std::unique_lock<std::mutex> lock(ds_mutex);
+        while(true){
+            if(ds_cohorts.empty() && ds_retries.empty()){
+                ds_cv.wait(lock, [this](){ return ds_stopping || !ds_queue.empty(); });
+                if(ds_queue.empty()){
+                    return;
+                }
+
+                // nothing to step yet, give concurrent requests a moment to start together
+                auto deadline = ds_queue.front().enqueued + ds_options.max_wait;
+                ds_cv.wait_until(lock, deadline, [this](){
+                    return ds_stopping || ds_queue.size() >= ds_options.max_batch;
+                });
+            }
+
+            // join between steps, as many as there are free rows; retries were
+            // already decoding, they go first and are never held back
+            std::size_t active = active_rows() + ds_retries.size();
+            std::size_t free_rows = active < ds_options.max_batch ? ds_options.max_batch - active : 0;
+            std::vector<Sequence> arrivals = std::move(ds_retries);
+            ds_retries.clear();
+            free_rows += arrivals.size();
+            while(!ds_queue.empty() && arrivals.size() < free_rows){
+                arrivals.push_back(std::move(ds_queue.front()));
+                ds_queue.pop_front();
+            }
+
+            lock.unlock();
+            admit(arrivals);
+            for(auto & cohort : ds_cohorts){
+                step(cohort);
+                if(cohort.sequences.empty()){
+                    retire(cohort);
+                }
+            }
+            ds_cohorts.erase(
+                std::remove_if(ds_cohorts.begin(), ds_cohorts.end(), [](const Cohort & cohort){ return cohort.sequences.empty(); }),
+                ds_cohorts.end()
+            );
+            lock.lock();
+        }
+    }
+
+    std::size_t DecoderScheduler::active_rows() const{
+        std::size_t rows = 0;
+        for(const auto & cohort : ds_cohorts){
+            rows += cohort.sequences.size();
+        }
+        return rows;
+    }
+
+    void DecoderScheduler::admit(std::vector<Sequence> & arrivals){
+        auto started = std::chrono::steady_clock::now();
+        for(const auto & sequence : arrivals){
+            ds_wait_us.record(std::chrono::duration<double, std::micro>(started - sequence.enqueued).count());
+        }
+
+        if(!ds_decoder.uses_cache()){
+            // prefixes are right-padded per step, so anyone can join a cohort with the same encoder shape
+            for(auto & sequence : arrivals){
+                std::vector<int64_t> shape = encoder_shape_of(*sequence.encoder_output);
+                auto cohort = std::find_if(ds_cohorts.begin(), ds_cohorts.end(), [&shape](const Cohort & c){ return c.encoder_shape == shape; });
+                if(cohort == ds_cohorts.end()){
+                    ds_cohorts.emplace_back();
+                    cohort = ds_cohorts.end() - 1;
+                    cohort->encoder_shape = std::move(shape);
+                }
+                cohort->sequences.push_back(std::move(sequence));
+                cohort->stale_states = true;
+            }
+            return;
+        }
+
+        // the cache holds exactly the prompt after the first step, so a new cohort
+        // needs one encoder shape and one prompt length
+        while(!arrivals.empty()){
+            std::vector<int64_t> shape = encoder_shape_of(*arrivals.front().encoder_output);
+            std::size_t prompt_length = arrivals.front().prompt_length;
+
+            std::vector<Sequence> group;
+            std::vector<Sequence> rest;
+            for(auto & sequence : arrivals){
+                if(sequence.prompt_length == prompt_length && encoder_shape_of(*sequence.encoder_output) == shape){
+                    group.push_back(std::move(sequence));
+                }else{
+                    rest.push_back(std::move(sequence));
+                }
+            }
+            arrivals = std::move(rest);
+            start_cohort(std::move(group), std::move(shape));
+        }
+    }
+
+    void DecoderScheduler::start_cohort(std::vector<Sequence> sequences, std::vector<int64_t> encoder_shape){
+        Cohort cohort;
+        cohort.sequences = std::move(sequences);
+        cohort.encoder_shape = std::move(encoder_shape);
+        if(!ds_idle_workspaces.empty()){
+            cohort.workspace = std::move(ds_idle_workspaces.back());
+            ds_idle_workspaces.pop_back();
+        }
+
+        try{
+            std::vector<const Ort::Value *> encoder_outputs;
+            std::vector<int64_t> input_ids;
+            std::vector<float> temperatures;
+            int max_length = 0;
+            for(const auto & sequence : cohort.sequences){
+                encoder_outputs.push_back(sequence.encoder_output);
+                input_ids.insert(input_ids.end(), sequence.tokens.begin(), sequence.tokens.end());
+                temperatures.push_back(sequence.temperature);
+                max_length = std::max(max_length, sequence.max_length);
+            }
+            cohort.encoder_states = WhisperDecoder::concat_rows(encoder_outputs);
+
+            ds_batch_sizes.record(static_cast<double>(cohort.sequences.size()));
+            WhisperDecoder::StepTokens next = ds_decoder.first_step(cohort.encoder_states, input_ids, cohort.sequences.size(), max_length, temperatures, cohort.workspace);
+            if(!ds_decoder.steps_need_encoder_states()){
+                // the cross attention cache is all later steps read
+                cohort.encoder_states = Ort::Value(nullptr);
+            }
+            advance(cohort, next);
+        }catch(...){
+            fail(cohort, std::current_exception());
+        }
+
+        if(cohort.sequences.empty()){
+            retire(cohort);
+        }else{
+            ds_cohorts.push_back(std::move(cohort));
+        }
+    }
+
+    void DecoderScheduler::step(Cohort & cohort){
+        if(cohort.sequences.empty()){
+            return;
+        }
+
+        try{
+            ds_batch_sizes.record(static_cast<double>(cohort.sequences.size()));
+
+            if(ds_decoder.uses_cache()){
+                //the workspace still holds each row's last token as its input
+                advance(cohort, ds_decoder.next_step(cohort.workspace));
+                return;
+            }
+
+            if(cohort.stale_states){
+                std::vector<const Ort::Value *> encoder_outputs;
+                for(const auto & sequence : cohort.sequences){
+                    encoder_outputs.push_back(sequence.encoder_output);
+                }
+                cohort.encoder_states = WhisperDecoder::concat_rows(encoder_outputs);
+                cohort.stale_states = false;
+            }
+
+            std::size_t length = 0;
+            for(const auto & sequence : cohort.sequences){
+                length = std::max(length, sequence.tokens.size());
+            }
+            // the padding sits after each row's last token, where causal attention never looks
+            std::vector<int64_t> input_ids(cohort.sequences.size() * length, 0);
+            std::vector<int64_t> last_positions;
+            std::vector<int64_t> prompt_lengths;
+            std::vector<float> temperatures;
+            for(std::size_t row = 0; row < cohort.sequences.size(); ++row){
+                const auto & tokens = cohort.sequences[row].tokens;
+                std::copy(tokens.begin(), tokens.end(), input_ids.begin() + row * length);
+                last_positions.push_back(static_cast<int64_t>(tokens.size()) - 1);
+                prompt_lengths.push_back(static_cast<int64_t>(cohort.sequences[row].prompt_length));
+                temperatures.push_back(cohort.sequences[row].temperature);
+            }
+            advance(cohort, ds_decoder.full_step(cohort.encoder_states, input_ids, cohort.sequences.size(), last_positions, prompt_lengths, temperatures, cohort.workspace));
+        }catch(...){
+            fail(cohort, std::current_exception());
+        }
+    }
+
+    void DecoderScheduler::advance(Cohort & cohort, const WhisperDecoder::StepTokens & next){
+        bool any_finished = false;
+        for(std::size_t row = 0; row < cohort.sequences.size(); ++row){
+            Sequence & sequence = cohort.sequences[row];
+            sequence.tokens.push_back(next.tokens[row]);
+            std::span<const int64_t> generated(sequence.tokens.data() + sequence.prompt_length, sequence.tokens.size() - sequence.prompt_length);
+            sequence.done = sequence.guard.push(generated, next.logprobs[row], next.no_speech_probs[row]);
+            any_finished = any_finished || sequence.done;
+        }
+        if(!any_finished){
+            return;
+        }
+
+        std::vector<std::size_t> keep;
+        std::vector<Sequence> remaining;
+        for(std::size_t row = 0; row < cohort.sequences.size(); ++row){
+            Sequence & sequence = cohort.sequences[row];
+            if(!sequence.done){
+                keep.push_back(row);
+                remaining.push_back(std::move(sequence));
+            }else if(!finish_attempt(sequence)){
+                ds_retries.push_back(std::move(sequence));
+            }
+        }
+        cohort.sequences = std::move(remaining);
+
+        if(cohort.sequences.empty()){
+            cohort.workspace.release();
+            cohort.encoder_states = Ort::Value(nullptr);
+            return;
+        }
+
+        // finished rows leave the batched tensors with them
+        if(ds_decoder.uses_cache()){
+            if(cohort.encoder_states){
+                cohort.encoder_states = WhisperDecoder::select_rows(cohort.encoder_states, keep);
+            }
+            ds_decoder.keep_rows(keep, cohort.encoder_states, cohort.workspace);
+        }else{
+            cohort.stale_states = true;
+        }
+    }
+
+    bool DecoderScheduler::finish_attempt(Sequence & sequence){
+        std::vector<int64_t> generated(sequence.tokens.begin() + sequence.prompt_length, sequence.tokens.end());
+        DecodeResult result = sequence.guard.result(std::move(generated), sequence.temperature);
+        if(sequence.previous){
+            result = merge_attempts(std::move(*sequence.previous), std::move(result));
+        }
+
+        const float temperature = next_fallback_temperature(sequence.guard_options, result);
+        if(temperature < 0.0f){
+            sequence.promise.set_value(std::move(result));
+            return true;
+        }
+
+        // the next attempt starts over from the prompt when the worker admits it
+        sequence.previous = std::move(result);
+        sequence.temperature = temperature;
+        sequence.tokens.resize(sequence.prompt_length);
+        sequence.guard = DecodeGuard(sequence.guard_options, sequence.eot, sequence.max_length, sequence.previous->attempts);
+        sequence.done = false;
+        sequence.enqueued = std::chrono::steady_clock::now();
+        return false;
+    }
+
+    void DecoderScheduler::fail(Cohort & cohort, std::exception_ptr error){
+        for(auto & sequence : cohort.sequences){
+            sequence.promise.set_exception(error);
+        }
+        cohort.sequences.clear();
+        cohort.workspace.release();
+        cohort.encoder_states = Ort::Value(nullptr);
+    }
+
+    void DecoderScheduler::retire(Cohort & cohort){
+        if(ds_decoder.uses_cache() && ds_idle_workspaces.size() < spare_workspaces){
+            cohort.workspace.release();
+            ds_idle_workspaces.push_back(std::move(cohort.workspace));
+        }
+    }
+}
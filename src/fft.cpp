@@ -0,0 +1,288 @@
+//file:: fft.cpp
+#include "include/fft.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        using cpx = std::complex<float>;
+
+        // plain multiply, std::complex's operator* takes a slow path for inf/nan
+        inline cpx cmul(const cpx & a, const cpx & b){
+            return cpx(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+        }
+
+        std::vector<cpx> make_twiddles(std::size_t n, std::size_t count){
+            std::vector<cpx> twiddles(count);
+            for(std::size_t k = 0; k < count; ++k){
+                double angle = -2.0 * M_PI * static_cast<double>(k) / static_cast<double>(n);
+                twiddles[k] = cpx(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+            }
+            return twiddles;
+        }
+    }
+
+    ComplexFFT::ComplexFFT(std::size_t n)
+    : c_n(n), c_twiddles(make_twiddles(n, n))
+    {
+        if(n == 0){
+            throw std::invalid_argument("FFT size must be positive");
+        }
+
+        // radix 4 first, then 2, then odd factors
+        std::size_t remaining = n;
+        std::size_t p = 4;
+        while(remaining > 1){
+            while(remaining % p != 0){
+                switch(p){
+                    case 4: p = 2; break;
+                    case 2: p = 3; break;
+                    default: p += 2; break;
+                }
+                if(p * p > remaining){
+                    p = remaining;
+                }
+            }
+            remaining /= p;
+            c_factors.push_back(p);
+            c_factors.push_back(remaining);
+        }
+        if(c_factors.empty()){
+            // n == 1
+            c_factors.push_back(1);
+            c_factors.push_back(1);
+        }
+    }
+
+    std::size_t ComplexFFT::size() const{
+        return c_n;
+    }
+
+    void ComplexFFT::forward(const cpx * input, cpx * output) const{
+        if(c_n == 1){
+            output[0] = input[0];
+            return;
+        }
+        work(output, input, 1, c_factors.data());
+    }
+
+    // decimation in time: each stage writes p sub-transforms of length m into
+    // `out`, then combines them with one radix-p butterfly per output column
+    void ComplexFFT::work(cpx * out, const cpx * in, std::size_t stride, const std::size_t * factors) const{
+        const std::size_t p = factors[0];
+        const std::size_t m = factors[1];
+        cpx * const out_begin = out;
+        cpx * const out_end = out + p * m;
+
+        if(m == 1){
+            do{
+                *out = *in;
+                in += stride;
+            }while(++out != out_end);
+        }else{
+            do{
+                work(out, in, stride * p, factors + 2);
+                in += stride;
+            }while((out += m) != out_end);
+        }
+
+        out = out_begin;
+        switch(p){
+            case 2: butterfly2(out, stride, m); break;
+            case 4: butterfly4(out, stride, m); break;
+            case 5: butterfly5(out, stride, m); break;
+            default: butterfly_generic(out, stride, m, p); break;
+        }
+    }
+
+    void ComplexFFT::butterfly2(cpx * out, std::size_t stride, std::size_t m) const{
+        cpx * out2 = out + m;
+        const cpx * tw = c_twiddles.data();
+        for(std::size_t k = 0; k < m; ++k){
+            cpx t = cmul(out2[k], *tw);
+            tw += stride;
+            out2[k] = out[k] - t;
+            out[k] += t;
+        }
+    }
+
+    void ComplexFFT::butterfly4(cpx * out, std::size_t stride, std::size_t m) const{
+        const cpx * tw1 = c_twiddles.data();
+        const cpx * tw2 = tw1;
+        const cpx * tw3 = tw1;
+        const std::size_t m2 = 2 * m;
+        const std::size_t m3 = 3 * m;
+
+        for(std::size_t k = 0; k < m; ++k, ++out){
+            cpx s0 = cmul(out[m], *tw1);
+            cpx s1 = cmul(out[m2], *tw2);
+            cpx s2 = cmul(out[m3], *tw3);
+            tw1 += stride;
+            tw2 += 2 * stride;
+            tw3 += 3 * stride;
+
+            cpx s5 = out[0] - s1;
+            out[0] += s1;
+            cpx s3 = s0 + s2;
+            cpx s4 = s0 - s2;
+
+            out[m2] = out[0] - s3;
+            out[0] += s3;
+            // s5 -/+ i*s4
+            out[m] = cpx(s5.real() + s4.imag(), s5.imag() - s4.real());
+            out[m3] = cpx(s5.real() - s4.imag(), s5.imag() + s4.real());
+        }
+    }
+
+    void ComplexFFT::butterfly5(cpx * out, std::size_t stride, std::size_t m) const{
+        const cpx ya = c_twiddles[stride * m];
+        const cpx yb = c_twiddles[stride * 2 * m];
+        const cpx * tw = c_twiddles.data();
+
+        cpx * out0 = out;
+        cpx * out1 = out + m;
+        cpx * out2 = out + 2 * m;
+        cpx * out3 = out + 3 * m;
+        cpx * out4 = out + 4 * m;
+
+        for(std::size_t u = 0; u < m; ++u){
+            cpx s0 = out0[u];
+            cpx s1 = cmul(out1[u], tw[u * stride]);
+            cpx s2 = cmul(out2[u], tw[2 * u * stride]);
+            cpx s3 = cmul(out3[u], tw[3 * u * stride]);
+            cpx s4 = cmul(out4[u], tw[4 * u * stride]);
+
+            cpx s7 = s1 + s4;
+            cpx s10 = s1 - s4;
+            cpx s8 = s2 + s3;
+            cpx s9 = s2 - s3;
+
+            out0[u] = s0 + s7 + s8;
+
+            cpx s5(s0.real() + s7.real() * ya.real() + s8.real() * yb.real(),
+                   s0.imag() + s7.imag() * ya.real() + s8.imag() * yb.real());
+            cpx s6(s10.imag() * ya.imag() + s9.imag() * yb.imag(),
+                   -s10.real() * ya.imag() - s9.real() * yb.imag());
+            out1[u] = s5 - s6;
+            out4[u] = s5 + s6;
+
+            cpx s11(s0.real() + s7.real() * yb.real() + s8.real() * ya.real(),
+                    s0.imag() + s7.imag() * yb.real() + s8.imag() * ya.real());
+            cpx s12(-s10.imag() * yb.imag() + s9.imag() * ya.imag(),
+                    s10.real() * yb.imag() - s9.real() * ya.imag());
+            out2[u] = s11 + s12;
+            out3[u] = s11 - s12;
+        }
+    }
+
+    void ComplexFFT::butterfly_generic(cpx * out, std::size_t stride, std::size_t m, std::size_t p) const{
+        // radix 3 and any larger prime; p is small for every size we plan
+        cpx stack_scratch[16];
+        std::vector<cpx> heap_scratch;
+        cpx * scratch = stack_scratch;
+        if(p > 16){
+            heap_scratch.resize(p);
+            scratch = heap_scratch.data();
+        }
+
+        for(std::size_t u = 0; u < m; ++u){
+            for(std::size_t q = 0, k = u; q < p; ++q, k += m){
+                scratch[q] = out[k];
+            }
+
+            for(std::size_t q1 = 0, k = u; q1 < p; ++q1, k += m){
+                std::size_t twiddle_index = 0;
+                cpx sum = scratch[0];
+                for(std::size_t q = 1; q < p; ++q){
+                    twiddle_index += stride * k;
+                    if(twiddle_index >= c_n){
+                        twiddle_index -= c_n;
+                    }
+                    sum += cmul(scratch[q], c_twiddles[twiddle_index]);
+                }
+                out[k] = sum;
+            }
+        }
+    }
+
+    RealFFT::RealFFT(std::size_t n)
+    : r_n(n), r_half(n >= 2 ? n / 2 : 1), r_twiddles(make_twiddles(n, n / 2 + 1))
+    {
+        if(n < 2 || n % 2 != 0){
+            throw std::invalid_argument("real FFT size must be even and at least 2");
+        }
+    }
+
+    std::size_t RealFFT::size() const{
+        return r_n;
+    }
+
+    std::size_t RealFFT::bins() const{
+        return r_n / 2 + 1;
+    }
+
+    RealFFT::Workspace RealFFT::make_workspace() const{
+        Workspace workspace;
+        workspace.packed.resize(r_n / 2);
+        workspace.spectrum.resize(r_n / 2);
+        return workspace;
+    }
+
+    void RealFFT::forward(const float * input, cpx * output, Workspace & workspace) const{
+        const std::size_t half = r_n / 2;
+        if(workspace.packed.size() != half){
+            workspace = make_workspace();
+        }
+
+        // even samples in the real part, odd samples in the imaginary part
+        for(std::size_t i = 0; i < half; ++i){
+            workspace.packed[i] = cpx(input[2 * i], input[2 * i + 1]);
+        }
+        r_half.forward(workspace.packed.data(), workspace.spectrum.data());
+
+        const cpx * z = workspace.spectrum.data();
+        output[0] = cpx(z[0].real() + z[0].imag(), 0.0f);
+        output[half] = cpx(z[0].real() - z[0].imag(), 0.0f);
+
+        // split Z into the spectra of the even and odd samples, then combine
+        for(std::size_t k = 1; k < half; ++k){
+            cpx a = z[k];
+            cpx b = std::conj(z[half - k]);
+            cpx even = 0.5f * (a + b);
+            cpx diff = 0.5f * (a - b);
+            // odd = -i * diff
+            cpx odd(diff.imag(), -diff.real());
+            output[k] = even + cmul(r_twiddles[k], odd);
+        }
+    }
+
+    void RealFFT::magnitude(const float * input, float * output, Workspace & workspace) const{
+        const std::size_t half = r_n / 2;
+        if(workspace.packed.size() != half){
+            workspace = make_workspace();
+        }
+
+        for(std::size_t i = 0; i < half; ++i){
+            workspace.packed[i] = cpx(input[2 * i], input[2 * i + 1]);
+        }
+        r_half.forward(workspace.packed.data(), workspace.spectrum.data());
+
+        const cpx * z = workspace.spectrum.data();
+        output[0] = std::fabs(z[0].real() + z[0].imag());
+        output[half] = std::fabs(z[0].real() - z[0].imag());
+
+        for(std::size_t k = 1; k < half; ++k){
+            cpx a = z[k];
+            cpx b = std::conj(z[half - k]);
+            cpx even = 0.5f * (a + b);
+            cpx diff = 0.5f * (a - b);
+            cpx odd(diff.imag(), -diff.real());
+            cpx x = even + cmul(r_twiddles[k], odd);
+            output[k] = std::sqrt(x.real() * x.real() + x.imag() * x.imag());
+        }
+    }
+}
@@ -0,0 +1,242 @@
+//file:: http_session.cpp
+#include "include/http_session.hpp"
+
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+
+namespace AIvoice{
+
+    HttpSession::HttpSession(boost::asio::ip::tcp::socket && socket, RequestHandler handler, const HttpSessionOptions & options)
+    : h_stream(std::move(socket)), h_idle_timer(h_stream.get_executor()), h_write_timer(h_stream.get_executor()),
+    h_handler(std::move(handler)), h_options(options),
+    h_read_state(ReadState::idle), h_writing(false), h_closing(false)
+    {
+    }
+
+    void HttpSession::start(){
+        // everything below runs on the connection's strand
+        boost::asio::dispatch(
+            h_stream.get_executor(),
+            [self = shared_from_this()](){
+                self->do_read();
+            }
+        );
+    }
+
+    void HttpSession::do_read(){
+        if(h_read_state != ReadState::idle || h_closing || h_queue.size() >= h_options.pipeline_limit){
+            return;
+        }
+
+        h_read_state = ReadState::header;
+        h_parser.emplace();
+        h_parser->body_limit(h_options.body_limit);
+
+        // waiting for the next request is bounded by the idle timer, so a slow
+        // inference on this connection does not trip the read deadline
+        h_stream.expires_never();
+        arm_idle_timer();
+
+        boost::beast::http::async_read_header(
+            h_stream, h_buffer, *h_parser,
+            [self = shared_from_this()](boost::beast::error_code ec, std::size_t){
+                self->on_header(ec);
+            }
+        );
+    }
+
+    void HttpSession::on_header(boost::beast::error_code ec){
+        h_idle_timer.cancel();
+        if(ec){
+            return on_read_error(ec);
+        }
+
+        h_read_state = ReadState::body;
+        h_stream.expires_after(h_options.read_timeout);
+        boost::beast::http::async_read(
+            h_stream, h_buffer, *h_parser,
+            [self = shared_from_this()](boost::beast::error_code ec, std::size_t){
+                self->on_read(ec);
+            }
+        );
+    }
+
+    void HttpSession::on_read(boost::beast::error_code ec){
+        if(ec){
+            return on_read_error(ec);
+        }
+
+        // the body's deadline is done with, a full pipeline leaves no read to reset it
+        h_stream.expires_never();
+        h_read_state = ReadState::idle;
+        dispatch(h_parser->release());
+    }
+
+    void HttpSession::on_read_error(boost::beast::error_code ec){
+        h_read_state = ReadState::idle;
+        h_closing = true;
+
+        if(ec == boost::beast::http::error::end_of_stream || ec == boost::beast::http::error::partial_message){
+            // peer is done sending, maybe in the middle of a request: nothing to
+            // answer that one with, flush what we owe it and then close
+            if(h_queue.empty() && !h_writing){
+                do_close();
+            }
+            return;
+        }
+
+        if(ec == boost::beast::http::error::body_limit){
+            enqueue_error(boost::beast::http::status::payload_too_large, h_parser->get().version());
+            return;
+        }
+
+        if(ec.category() == boost::beast::http::make_error_code(boost::beast::http::error::bad_target).category()){
+            enqueue_error(boost::beast::http::status::bad_request, h_parser->get().version());
+            return;
+        }
+
+        if(ec != boost::asio::error::operation_aborted && ec != boost::beast::error::timeout){
+            std::cerr << "Error reading request: " << ec.message() << std::endl;
+        }
+        do_close();
+    }
+
+    void HttpSession::dispatch(HttpRequest && req){
+        if(!req.keep_alive()){
+            h_closing = true;
+        }
+
+        auto slot = std::make_shared<Pending>();
+        h_queue.push_back(slot);
+
+        h_handler(
+            std::move(req),
+            [self = shared_from_this(), slot](HttpResponse && res){
+                // handlers may answer from another thread, hop back onto the strand
+                boost::asio::post(
+                    self->h_stream.get_executor(),
+                    [self, slot, res = std::move(res)]() mutable {
+                        slot->response = std::move(res);
+                        slot->ready = true;
+                        self->do_write();
+                    }
+                );
+            }
+        );
+
+        // pipelined requests are read while earlier ones are still being handled
+        do_read();
+    }
+
+    void HttpSession::enqueue_error(boost::beast::http::status status, unsigned int version){
+        nlohmann::json res_json;
+        res_json["status"] = "error";
+        res_json["message"] = std::string(boost::beast::http::obsolete_reason(status));
+        std::string response_body = res_json.dump();
+
+        auto slot = std::make_shared<Pending>();
+        slot->response = HttpResponse{status, version};
+        slot->response.set(boost::beast::http::field::server, "AIvoice-Server");
+        slot->response.set(boost::beast::http::field::content_type, "application/json");
+        slot->response.keep_alive(false);
+        slot->response.body() = std::move(response_body);
+        slot->response.prepare_payload();
+        slot->ready = true;
+
+        h_queue.push_back(slot);
+        do_write();
+    }
+
+    void HttpSession::do_write(){
+        if(h_writing || h_queue.empty() || !h_queue.front()->ready || !h_stream.socket().is_open()){
+            return;
+        }
+
+        h_writing = true;
+        auto slot = h_queue.front();
+        bool keep_alive = slot->response.keep_alive();
+
+        arm_write_timer();
+        boost::beast::http::async_write(
+            h_stream, slot->response,
+            [self = shared_from_this(), slot, keep_alive](boost::beast::error_code ec, std::size_t){
+                self->on_write(ec, keep_alive);
+            }
+        );
+    }
+
+    void HttpSession::on_write(boost::beast::error_code ec, bool keep_alive){
+        h_writing = false;
+        h_write_timer.cancel();
+        if(ec){
+            if(ec != boost::asio::error::operation_aborted){
+                std::cerr << "Error writing response: " << ec.message() << std::endl;
+            }
+            return do_close();
+        }
+
+        h_queue.pop_front();
+
+        if(!keep_alive || (h_closing && h_queue.empty() && h_read_state == ReadState::idle)){
+            return do_close();
+        }
+
+        // resumes reading if the pipeline was full, and restarts the idle
+        // clock if this was the last outstanding response
+        do_read();
+        arm_idle_timer();
+        do_write();
+    }
+
+    void HttpSession::arm_idle_timer(){
+        if(h_read_state != ReadState::header || !h_queue.empty()){
+            return;
+        }
+
+        h_idle_timer.expires_after(h_options.idle_timeout);
+        h_idle_timer.async_wait(
+            [self = shared_from_this()](boost::beast::error_code ec){
+                if(ec == boost::asio::error::operation_aborted){
+                    return;
+                }
+                // the timer may have been re-armed after this wait completed
+                if(self->h_idle_timer.expiry() > std::chrono::steady_clock::now()){
+                    return;
+                }
+                if(self->h_read_state == ReadState::header && self->h_queue.empty()){
+                    self->do_close();
+                }
+            }
+        );
+    }
+
+    void HttpSession::arm_write_timer(){
+        h_write_timer.expires_after(h_options.write_timeout);
+        h_write_timer.async_wait(
+            [self = shared_from_this()](boost::beast::error_code ec){
+                if(ec == boost::asio::error::operation_aborted){
+                    return;
+                }
+                // a later write may have re-armed the timer after this wait completed
+                if(self->h_write_timer.expiry() > std::chrono::steady_clock::now()){
+                    return;
+                }
+                // closing aborts the write, on_write then sees operation_aborted
+                if(self->h_writing){
+                    self->do_close();
+                }
+            }
+        );
+    }
+
+    void HttpSession::do_close(){
+        h_closing = true;
+        h_idle_timer.cancel();
+        h_write_timer.cancel();
+
+        boost::beast::error_code ec;
+        h_stream.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+        h_stream.close();
+    }
+}
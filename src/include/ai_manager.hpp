@@ -9,40 +9,175 @@
 #include <complex>
 #include <cmath>
 #include <algorithm>
+#include <span>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <future>
 #include <onnxruntime/onnxruntime_cxx_api.h>
 
+#include "micro_batcher.hpp"
+#include "mel_frontend.hpp"
+#include "whisper_decoder.hpp"
+#include "decoder_scheduler.hpp"
+#include "vad.hpp"
+#include "chunk_planner.hpp"
+#include "pcm_input.hpp"
+#include "av_decoding.hpp"
+
+struct AVFormatContext;
+
+
+struct AIManagerOptions{
+    std::string labels_path = "../labels/imagenet_classes.txt";
+    std::string vocab_path = "../labels/whisper_vocab.json";
+    // token ids the decoder never picks, on top of Whisper's special and
+    // timestamp tokens, which are always suppressed
+    std::vector<int64_t> suppress_tokens;
+    // a chunk cannot start with a blank or end of text, as in Whisper
+    bool suppress_blank = true;
+    // loops and low-confidence text stop a chunk's decoding early
+    AIvoice::DecodeGuardOptions decode_guard;
+
+    // per session; 0 leaves the choice to onnxruntime. requests already run
+    // side by side on the compute pool, so small values avoid oversubscription
+    int intra_op_threads = 1;
+    int inter_op_threads = 1;
+
+    // threads one request may use for its own decode/feature work. the extra
+    // ones come from a single pool of preprocess_threads - 1, shared by all requests
+    std::size_t preprocess_threads = 4;
+    // opened audio decoders kept for reuse between requests
+    std::size_t audio_decoder_pool = 8;
+
+    // concurrent /upload requests are gathered into one [N,3,224,224] run;
+    // max_batch 1 turns this off. /upload answers from the batch's completion,
+    // so a batch fills from every admitted request, not one per compute thread
+    AIvoice::MicroBatcherOptions image_batching;
+
+    // token steps of concurrent transcriptions share decoder calls;
+    // max_batch 1 decodes every chunk on its own request thread
+    AIvoice::DecoderSchedulerOptions decoder_batching;
+
+    // chunks of long files and of concurrent requests are encoded as one
+    // [N,80,T] run; max_batch 1 encodes one chunk at a time
+    AIvoice::MicroBatcherOptions encoder_batching{4, std::chrono::microseconds(3000)};
+
+    // chunks without speech are never encoded or decoded
+    AIvoice::VadOptions vad;
+
+    // chunks are cut at pauses, at most chunking.max_samples long
+    AIvoice::ChunkPlannerOptions chunking;
+    // the encoder takes any number of frames, so short chunks are not padded
+    // to the full window. stock Whisper exports need false
+    bool encoder_dynamic_length = false;
+    // trimmed inputs keep this much padding after the audio, and are rounded
+    // up to a multiple of the bucket so chunks of similar length share a run
+    int encoder_length_margin_ms = 200;
+    int encoder_length_bucket_ms = 1000;
+};
+
+struct TranscriptionResult{
+    // the transcription, or an "Error: ..." message
+    std::string text;
+    // per-request details for the response, e.g. how much audio the VAD skipped
+    nlohmann::json report;
+};
 
 class AIManager{
     public:
-        AIManager();
+        explicit AIManager(const AIManagerOptions & options = AIManagerOptions());
         ~AIManager();
 
         void load_image_model(const std::string & modelpath);
 
         std::string run_image_inference(const std::string & image_file_path);
-
-        void load_audio_model(const std::string & encoder_path, const std::string & decoder_path);
-        std::string transcribe_audio(const std::string & audio_file_path);
+        // decodes straight from the uploaded bytes, nothing touches the disk
+        std::string run_image_inference(std::span<const unsigned char> image_bytes);
+        using ImageCompletion = std::function<void(std::future<std::string>)>;
+        // same, but returns once the image is decoded and queued: `done` gets the
+        // result on the image batcher's thread, or right away without batching.
+        // callers that do not wait let batches fill past one per blocked thread
+        void run_image_inference(std::span<const unsigned char> image_bytes, ImageCompletion done);
+        // decodes the images in parallel, then classifies them in as few runs as
+        // the model allows. results are in input order, failures are per image
+        std::vector<std::string> run_image_inference(const std::vector<std::span<const unsigned char>> & images);
+
+        // decoder_with_past_path is optional, without it every decoder step reruns the whole prefix
+        void load_audio_model(const std::string & encoder_path, const std::string & decoder_path, const std::string & decoder_with_past_path = "");
+        TranscriptionResult transcribe_audio(const std::string & audio_file_path);
+        // PCM WAV, and raw PCM named by `content_type` (audio/L16, audio/pcm;rate=..),
+        // are read in place; anything else is demuxed and decoded from the uploaded
+        // bytes through a custom AVIOContext
+        TranscriptionResult transcribe_audio(std::span<const unsigned char> audio_bytes, std::string_view content_type = {});
+        // already decoded 16 kHz mono samples
+        TranscriptionResult transcribe_pcm(const std::vector<float> & pcm_data);
+
+        // batcher histograms and other tuning counters
+        nlohmann::json stats() const;
 
 
     private:
 
+        Ort::SessionOptions make_session_options() const;
+
+        // resize, normalize and classify 3-channel pixels, takes ownership of stbi's buffer
+        std::string classify_image(unsigned char * image_data, int width, int height);
+        void classify_image(unsigned char * image_data, int width, int height, ImageCompletion done);
+        std::vector<float> preprocess_image(unsigned char * image_data, int width, int height);
+        // one session run over every image, returns one result string per image
+        std::vector<std::string> run_image_batch(std::vector<std::vector<float>> & images);
+
         void load_labels(const std::string & label_path);
         void get_input_output_name(const Ort::Session & session);
-        std::string decode_and_transcribe(const Ort::Value & encoder_output);
+        // receives decoded samples in order, false stops the decode
+        using PcmSink = std::function<bool(const float * samples, size_t count)>;
+        // decodes the best audio stream of an opened input into `sink`, returns an error message or ""
+        std::string decode_audio(AVFormatContext * fmt_ctx, const PcmSink & sink);
+        // pipeline over the samples `source` feeds its sink: a producer thread decodes,
+        // plans chunks and computes their features while this thread encodes and
+        // decodes them, with a bounded queue in between. memory stays at a few
+        // chunks however long the audio is
+        TranscriptionResult transcribe_stream(const std::function<std::string(const PcmSink &)> & source);
+        // uncompressed samples straight from the caller's buffer, resampled only when not 16 kHz
+        TranscriptionResult transcribe_pcm_input(const AIvoice::PcmAudio & audio);
+        // samples fed to the mel frontend for a chunk, zero padding included
+        size_t encoder_input_samples(size_t chunk_samples) const;
+        // [80, T] features of each chunk to its last_hidden_state, in order
+        std::vector<Ort::Value> encode_chunks(std::vector<std::vector<float>> & features);
+        // one encoder run per distinct T over every chunk of that length
+        std::vector<Ort::Value> run_encoder_batch(std::vector<std::vector<float>> & features);
+        // chunks whose tokens are being decoded; the scheduler reads encoder_outputs
+        // until every future is ready
+        struct DecodingWindow{
+            std::vector<Ort::Value> encoder_outputs;
+            std::vector<std::future<AIvoice::DecodeResult>> results;
+        };
+        // submits every chunk to the decoder scheduler, or decodes them here on
+        // the request's `workspace` without one
+        DecodingWindow start_decoding(std::vector<Ort::Value> encoder_outputs, AIvoice::WhisperDecoder::Workspace & workspace);
+        // text of the window's chunks, in order; how each chunk's decoding went
+        // is appended to `chunk_reports`
+        std::string finish_decoding(DecodingWindow & window, nlohmann::json & chunk_reports);
         void load_whisper_vocab(const std::string & vocab_path);
+        // suppression masks and the no-speech token for `decoder`'s logits
+        AIvoice::LogitsProcessor make_logits_processor(const Ort::Session & decoder) const;
 
 
 
-        std::vector<std::vector<float>> create_mel_filter_bank();
-        void computeFFT(const std::vector<float> & input, std::vector<float> & output_magnitude);
+
+        AIManagerOptions a_options;
 
         Ort::Env a_env;
         Ort::Session a_session;
         Ort::Session a_encoder_session;
         Ort::Session a_decoder_session;
+        Ort::Session a_decoder_with_past_session;
+        Ort::Session a_vad_session;
 
         bool a_image_model_loaded;
+        // most images the image session takes in one run
+        size_t a_image_run_batch;
         bool a_audio_model_loaded;
 
 
@@ -52,8 +187,34 @@ class AIManager{
         const int a_hop_length;
         const int a_n_mel;
 
+        // window, FFT plan and mel filters, built once and shared by every transcription
+        const AIvoice::MelFrontend a_mel_frontend;
+        const AIvoice::ChunkPlanner a_chunk_planner;
+        AIvoice::DecoderPool a_decoder_pool;
+        // helpers of the mel and image preprocessing, created once for every request
+        AIvoice::WorkerPool a_preprocess_pool;
+
         std::vector<std::string> a_labels;
 
         std::map<int64_t, std::string> a_whisper_vocab;
+        // special tokens, looked up in the tokenizer's added tokens when it has them.
+        // ids above eot are special or timestamps and never part of the text
+        int64_t a_sot_token;
+        int64_t a_eot_token;
+        // -1 when the tokenizer has none
+        int64_t a_no_speech_token;
+        // after sot in the prompt, so the model writes text rather than timestamps
+        int64_t a_no_timestamps_token;
+        int64_t a_blank_token;
+
+        // after the sessions it runs
+        std::unique_ptr<AIvoice::WhisperDecoder> a_whisper_decoder;
+        std::unique_ptr<AIvoice::VoiceActivityDetector> a_vad;
+        // after the decoder it drives
+        std::unique_ptr<AIvoice::DecoderScheduler> a_decoder_scheduler;
+        std::unique_ptr<AIvoice::MicroBatcher<std::vector<float>, Ort::Value>> a_encoder_batcher;
+
+        // after the sessions, so it is stopped before they are released
+        std::unique_ptr<AIvoice::MicroBatcher<std::vector<float>, std::string>> a_image_batcher;
         
 };
\ No newline at end of file
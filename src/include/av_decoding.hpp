@@ -0,0 +1,106 @@
+//file:: av_decoding.hpp
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+struct AVCodecContext;
+struct AVCodecParameters;
+struct AVFormatContext;
+struct AVFrame;
+struct AVIOContext;
+struct AVPacket;
+
+
+namespace AIvoice{
+
+    // owners for FFmpeg objects, so early returns cannot leak them
+    struct FormatContextDeleter{
+        // avformat_close_input; a custom AVIOContext is left to its own owner
+        void operator()(AVFormatContext * context) const;
+    };
+    struct IOContextDeleter{
+        // FFmpeg may have swapped the buffer, frees whichever it holds
+        void operator()(AVIOContext * context) const;
+    };
+    struct CodecContextDeleter{
+        void operator()(AVCodecContext * context) const;
+    };
+    struct PacketDeleter{
+        void operator()(AVPacket * packet) const;
+    };
+    struct FrameDeleter{
+        void operator()(AVFrame * frame) const;
+    };
+
+    using FormatContextPtr = std::unique_ptr<AVFormatContext, FormatContextDeleter>;
+    using IOContextPtr = std::unique_ptr<AVIOContext, IOContextDeleter>;
+    using CodecContextPtr = std::unique_ptr<AVCodecContext, CodecContextDeleter>;
+    using PacketPtr = std::unique_ptr<AVPacket, PacketDeleter>;
+    using FramePtr = std::unique_ptr<AVFrame, FrameDeleter>;
+
+    // opened audio decoders and their packet/frame, kept between requests.
+    // a returned decoder is flushed and handed to the next stream with the same
+    // codec id and parameters, which skips codec lookup, allocation and open.
+    // leases are exclusive, so the pool is shared by every decoding thread and
+    // holds about one set per thread that decodes concurrently.
+    class DecoderPool{
+        public:
+            class Lease{
+                public:
+                    Lease() = default;
+                    Lease(Lease && other) noexcept;
+                    Lease & operator=(Lease && other) noexcept;
+                    ~Lease();
+
+                    AVCodecContext * codec() const;
+                    AVPacket * packet() const;
+                    AVFrame * frame() const;
+                    explicit operator bool() const;
+
+                private:
+                    friend class DecoderPool;
+
+                    DecoderPool * pool = nullptr;
+                    std::string key;
+                    CodecContextPtr codec_context;
+                    PacketPtr packet_ptr;
+                    FramePtr frame_ptr;
+            };
+
+            // `threads` is the codec thread count, frame and slice threading are
+            // enabled where the codec has them
+            DecoderPool(std::size_t max_idle, int threads);
+
+            DecoderPool(const DecoderPool &) = delete;
+            DecoderPool & operator=(const DecoderPool &) = delete;
+
+            // an opened decoder for the stream, empty when FFmpeg has none or it fails to open
+            Lease acquire(const AVCodecParameters * parameters);
+
+            // opened vs reused decoders and what sits idle
+            nlohmann::json stats() const;
+
+        private:
+            struct Idle{
+                std::string key;
+                CodecContextPtr codec;
+            };
+
+            void release(Lease & lease);
+
+            const std::size_t dp_max_idle;
+            const int dp_threads;
+
+            mutable std::mutex dp_mutex;
+            // most recently returned last
+            std::vector<Idle> dp_idle_codecs;
+            std::vector<std::pair<PacketPtr, FramePtr>> dp_idle_buffers;
+            std::size_t dp_opened;
+            std::size_t dp_reused;
+    };
+}
@@ -0,0 +1,14 @@
+//file:: bench.hpp
+#pragma once
+
+#include <string>
+
+#include "config.hpp"
+
+
+namespace AIvoice{
+
+    // `aivoice --bench <name>`: runs one microbenchmark, prints its report and
+    // returns the process exit code. unknown names list the available ones
+    int run_benchmark(const std::string & name, const ServerConfig & config);
+}
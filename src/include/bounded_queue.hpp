@@ -0,0 +1,82 @@
+//file:: bounded_queue.hpp
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+
+namespace AIvoice{
+
+    // fixed-capacity FIFO between pipeline stages. a full queue blocks the
+    // producer, so a fast stage can only run `capacity` items ahead of a slow one.
+    // close() ends the stream from either side: pushes fail from then on, and
+    // pops drain what is left before returning nothing.
+    template<typename T>
+    class BoundedQueue{
+        public:
+            explicit BoundedQueue(std::size_t capacity)
+            : q_capacity(capacity == 0 ? 1 : capacity), q_closed(false)
+            {
+            }
+
+            BoundedQueue(const BoundedQueue &) = delete;
+            BoundedQueue & operator=(const BoundedQueue &) = delete;
+
+            // blocks while full, false once the queue is closed
+            bool push(T item){
+                std::unique_lock<std::mutex> lock(q_mutex);
+                q_not_full.wait(lock, [this](){ return q_closed || q_items.size() < q_capacity; });
+                if(q_closed){
+                    return false;
+                }
+                q_items.push_back(std::move(item));
+                lock.unlock();
+                q_not_empty.notify_one();
+                return true;
+            }
+
+            // blocks while empty, nothing once closed and drained
+            std::optional<T> pop(){
+                std::unique_lock<std::mutex> lock(q_mutex);
+                q_not_empty.wait(lock, [this](){ return q_closed || !q_items.empty(); });
+                return take(lock);
+            }
+
+            // nothing when empty right now
+            std::optional<T> try_pop(){
+                std::unique_lock<std::mutex> lock(q_mutex);
+                return take(lock);
+            }
+
+            void close(){
+                {
+                    std::lock_guard<std::mutex> lock(q_mutex);
+                    q_closed = true;
+                }
+                q_not_full.notify_all();
+                q_not_empty.notify_all();
+            }
+
+        private:
+            std::optional<T> take(std::unique_lock<std::mutex> & lock){
+                if(q_items.empty()){
+                    return std::nullopt;
+                }
+                std::optional<T> item(std::move(q_items.front()));
+                q_items.pop_front();
+                lock.unlock();
+                q_not_full.notify_one();
+                return item;
+            }
+
+            const std::size_t q_capacity;
+            std::mutex q_mutex;
+            std::condition_variable q_not_full;
+            std::condition_variable q_not_empty;
+            std::deque<T> q_items;
+            bool q_closed;
+    };
+}
@@ -0,0 +1,48 @@
+//file:: chunk_planner.hpp
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "vad.hpp"
+
+
+namespace AIvoice{
+
+    struct ChunkPlannerOptions{
+        // longest chunk, the encoder's 15 s window
+        std::size_t max_samples = 240240;
+        // a long stretch of speech is split at the quietest point within
+        // this many samples before the window end
+        std::size_t search_samples = 64000;
+    };
+
+    // [begin, end) in samples
+    struct AudioChunk{
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    // cuts audio into encoder chunks at pauses instead of fixed offsets.
+    // consecutive speech regions are packed into one chunk while they fit;
+    // the silence between two chunks is left out. a region longer than a
+    // chunk is split at the lowest-energy 50 ms near the end of the window.
+    class ChunkPlanner{
+        public:
+            explicit ChunkPlanner(const ChunkPlannerOptions & options);
+
+            // chunks covering `regions` in order, none when there are no regions
+            std::vector<AudioChunk> plan(const float * samples, std::size_t count, const std::vector<SpeechRegion> & regions) const;
+
+            // chunks covering all of [0, count)
+            std::vector<AudioChunk> plan(const float * samples, std::size_t count) const;
+
+            std::size_t max_samples() const;
+
+        private:
+            // quietest split point in [from, to)
+            std::size_t find_pause(const float * samples, std::size_t from, std::size_t to) const;
+
+            ChunkPlannerOptions p_options;
+    };
+}
@@ -0,0 +1,54 @@
+//file:: chunk_stream.hpp
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#include "chunk_planner.hpp"
+#include "vad.hpp"
+
+
+namespace AIvoice{
+
+    // runs the VAD and the chunk planner over audio as it is decoded, holding
+    // at most three chunks of samples instead of the whole file.
+    //
+    // the planner only sees a window of buffered audio. a chunk starting in the
+    // first two thirds of the window ends inside it, so it is final and handed
+    // to `on_chunk`; the rest is planned again once more audio arrives. the
+    // VAD's noise floor is therefore per window rather than per file.
+    class ChunkStream{
+        public:
+            // `samples` is valid during the call only. false stops the stream
+            using ChunkSink = std::function<bool(const AudioChunk & chunk, const float * samples)>;
+
+            // `vad` may be null to plan every sample. both must outlive the stream
+            ChunkStream(const ChunkPlanner & planner, const VoiceActivityDetector * vad, ChunkSink on_chunk);
+
+            // false once the sink has stopped the stream
+            bool append(const float * samples, std::size_t count);
+            // plans whatever is still buffered
+            bool finish();
+
+            // samples appended so far
+            std::size_t total_samples() const;
+            // samples inside speech regions of the audio planned so far
+            std::size_t speech_samples() const;
+
+        private:
+            // plans the buffer and drops the audio that can no longer change
+            bool process(bool final);
+
+            const ChunkPlanner & cs_planner;
+            const VoiceActivityDetector * cs_vad;
+            ChunkSink cs_on_chunk;
+
+            const std::size_t cs_window;
+            std::vector<float> cs_buffer;
+            // absolute position of cs_buffer[0]
+            std::size_t cs_base;
+            std::size_t cs_speech_samples;
+            bool cs_stopped;
+    };
+}
@@ -0,0 +1,50 @@
+//file:: config.hpp
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+#include "ai_manager.hpp"
+#include "http_session.hpp"
+
+
+namespace AIvoice{
+
+    // everything that is tuned per host, see usage() for the flags
+    struct ServerConfig{
+        std::string host = "localhost";
+        unsigned int port = 8080;
+
+        // threads running the io_context (accept, parse, write)
+        int io_threads = 1;
+        // threads running model inference, and how many more jobs may wait for one
+        std::size_t compute_threads = 2;
+        std::size_t queue_depth = 16;
+
+        std::string image_model_path = "../models/mobilenetv2-7.onnx";
+        std::string encoder_model_path = "../models/whisper_base/encoder_model.onnx";
+        std::string decoder_model_path = "../models/whisper_base/decoder_model.onnx";
+        // optional, enables KV-cached decoding when the file exists
+        std::string decoder_with_past_model_path = "../models/whisper_base/decoder_with_past_model.onnx";
+
+        // keep a copy of every upload on disk, written off the request path
+        bool persist_uploads = false;
+        std::string upload_dir = "../uploaded_files";
+
+        HttpSessionOptions session;
+        AIManagerOptions ai;
+
+        // set by --help, main prints usage() and exits
+        bool show_help = false;
+        // set by --bench <name>, main runs that benchmark instead of the server
+        std::string bench;
+        // --bench-audio, comma separated inputs for benchmarks that transcribe
+        std::string bench_audio;
+    };
+
+    // defaults, then the --config json file (if any), then the remaining flags.
+    // throws std::invalid_argument on unknown options or bad values
+    ServerConfig parse_config(int argc, char ** argv);
+
+    std::string usage(const std::string & program);
+}
@@ -0,0 +1,127 @@
+//file:: decode_guard.hpp
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+
+namespace AIvoice{
+
+    // why a chunk's decoding ended
+    enum class StopReason{
+        eot,
+        max_length,
+        // the same n-gram kept coming back, e.g. "thank you thank you ..."
+        repetition,
+        compression_ratio,
+        low_logprob,
+        // the first step's no-speech probability ended the chunk without text
+        no_speech
+    };
+
+    const char * stop_reason_name(StopReason reason);
+
+    struct DecodeGuardOptions{
+        // stop once the last ngram_size tokens have occurred max_ngram_repeats
+        // times; either at 0 turns the check off
+        int ngram_size = 4;
+        int max_ngram_repeats = 3;
+        // stop once the tokens compress better than this, as tokens per phrase
+        // of an LZ77 parse over the token ids; 0 turns it off. whisper's 2.4 is
+        // on a gzip scale and has no counterpart here yet, so it is off
+        float max_compression_ratio = 0.0f;
+        // stop once the average logprob falls below this, only when a fallback
+        // attempt follows to decode the chunk again; the last attempt runs to
+        // eot or max_length. 0 or above turns it off
+        float min_avg_logprob = -1.0f;
+        // the compression and logprob checks wait for this many tokens
+        int min_tokens = 16;
+        // leave a decoded chunk without text when the no-speech probability
+        // read at its first step is above this and its average logprob is
+        // below min_avg_logprob (whisper's rule; with that check off the
+        // probability alone decides). 1 or above turns it off
+        float no_speech_threshold = 0.6f;
+        // after an early stop the chunk is decoded again by sampling at each of
+        // these temperatures in turn, until an attempt is not stopped early
+        std::vector<float> fallback_temperatures;
+    };
+
+    // one chunk's decoding
+    struct DecodeResult{
+        // generated tokens, eot included when it was produced; a repetition
+        // stop keeps the text before the repeats
+        std::vector<int64_t> tokens;
+        StopReason stop_reason = StopReason::max_length;
+        float avg_logprob = 0.0f;
+        float compression_ratio = 1.0f;
+        // read at the first step of the attempt kept
+        float no_speech_prob = 0.0f;
+        // of the attempt kept, 0 is greedy
+        float temperature = 0.0f;
+        int attempts = 0;
+        // decoder steps over every attempt
+        int steps = 0;
+
+        // stopped by a detector rather than by eot or max_length, and not
+        // taken for silence by the no-speech rule; only these are decoded again
+        bool stopped_early() const;
+    };
+
+    // online checks over one sequence's generated tokens, a few comparisons per
+    // token. one per decoding attempt, fed every token as it is generated
+    class DecodeGuard{
+        public:
+            // `attempt` counts from 0, the greedy one
+            DecodeGuard(const DecodeGuardOptions & options, int64_t eot, int max_length, int attempt = 0);
+
+            // `generated` ends with the newest token, `logprob` is its log-probability
+            // and `no_speech_prob` the chunk's no-speech probability, read only
+            // with the first token. true when decoding stops after it, with the
+            // reason in stop_reason(); the no-speech rule waits for result()
+            bool push(std::span<const int64_t> generated, float logprob, float no_speech_prob);
+
+            StopReason stop_reason() const;
+            // the attempt's result over the same tokens push() saw, without text
+            // and with StopReason::no_speech when the no-speech rule holds
+            DecodeResult result(std::vector<int64_t> generated, float temperature) const;
+
+        private:
+            // the LZ77 phrase being matched grows by the newest token
+            void extend_phrase(std::span<const int64_t> generated);
+            // where the newest n-gram occurs for the second time, -1 while it
+            // occurs fewer than max_ngram_repeats times
+            std::ptrdiff_t repeat_start(std::span<const int64_t> generated) const;
+            float compression_ratio(std::size_t length) const;
+            // high no-speech probability and low confidence in the tokens
+            bool no_speech(float avg_logprob) const;
+
+            // a copy, the guard moves with the sequence it watches
+            DecodeGuardOptions g_options;
+            int64_t g_eot;
+            int g_max_length;
+            // a fallback attempt follows this one, so a low logprob may end it
+            bool g_retry_left;
+            StopReason g_stop_reason;
+
+            double g_logprob_sum;
+            float g_no_speech_prob;
+            // generated tokens kept by a repetition stop: everything before the
+            // second occurrence of the repeated n-gram
+            std::size_t g_keep;
+
+            // LZ77 parse: phrases closed so far, start of the open one, and the
+            // earlier positions its tokens still match
+            std::size_t g_phrases;
+            std::size_t g_phrase_start;
+            std::vector<std::size_t> g_candidates;
+    };
+
+    // the temperature of the attempt after `result`, negative when there is none
+    float next_fallback_temperature(const DecodeGuardOptions & options, const DecodeResult & result);
+    // `next` attempt merged into the one before: the better one is kept and the
+    // attempts and steps are summed. an attempt that was not stopped early wins,
+    // between early stops the higher average logprob does
+    DecodeResult merge_attempts(DecodeResult previous, DecodeResult next);
+}
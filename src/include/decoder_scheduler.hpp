@@ -0,0 +1,132 @@
+//file:: decoder_scheduler.hpp
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <onnxruntime/onnxruntime_cxx_api.h>
+
+#include "metrics.hpp"
+#include "whisper_decoder.hpp"
+
+
+namespace AIvoice{
+
+    struct DecoderSchedulerOptions{
+        // sequences decoded together in one decoder call
+        std::size_t max_batch = 8;
+        // how long an idle scheduler waits for more sequences to start with
+        std::chrono::microseconds max_wait{2000};
+    };
+
+    // runs the token loops of every in-flight transcription on one worker, one
+    // batched decoder call per step instead of one call per sequence.
+    // sequences join at the next step after they are submitted and leave when
+    // they produce eot, reach max_length or are stopped by their DecodeGuard.
+    // a sequence stopped early goes back in line for its fallback attempts.
+    //
+    // without the KV cache all sequences over equally shaped encoder outputs
+    // share one call, right-padded to the longest prefix. with the cache the
+    // export has no attention mask, so only sequences with the same cache length
+    // can share a call: those that start on the same step form a cohort and stay
+    // together until they finish, one call per cohort per step. a cached cohort
+    // steps on a WhisperDecoder::Workspace; finished cohorts leave up to two idle
+    // for the next ones, so steady traffic decodes on buffers that are already
+    // there and a burst's extra workspaces are freed when it ends.
+    class DecoderScheduler{
+        public:
+            DecoderScheduler(const WhisperDecoder & decoder, const DecoderSchedulerOptions & options);
+            ~DecoderScheduler();
+
+            DecoderScheduler(const DecoderScheduler &) = delete;
+            DecoderScheduler & operator=(const DecoderScheduler &) = delete;
+
+            // same result as WhisperDecoder::decode, except for the tokens fallback
+            // attempts sample. `encoder_output` is read until the future is ready,
+            // the caller keeps it alive until then
+            std::future<DecodeResult> submit(const Ort::Value & encoder_output, std::vector<int64_t> prompt, int64_t eot, int max_length, const DecodeGuardOptions & guard);
+
+            // rows per decoder call and queueing delay before a sequence's first step
+            nlohmann::json stats() const;
+
+        private:
+            static DecoderSchedulerOptions sanitize(DecoderSchedulerOptions options);
+
+            struct Sequence{
+                const Ort::Value * encoder_output;
+                // prompt, then every generated token
+                std::vector<int64_t> tokens;
+                std::size_t prompt_length;
+                int64_t eot;
+                int max_length;
+                DecodeGuardOptions guard_options;
+                DecodeGuard guard;
+                // sampling temperature of this attempt, 0 is greedy
+                float temperature;
+                // the attempts before this one
+                std::optional<DecodeResult> previous;
+                // the guard stopped the attempt on its last token
+                bool done;
+                std::promise<DecodeResult> promise;
+                std::chrono::steady_clock::time_point enqueued;
+            };
+
+            // sequences sharing decoder calls, rows in the order of `sequences`
+            struct Cohort{
+                std::vector<Sequence> sequences;
+                // encoder output dims after the batch one; cohorts never mix shapes
+                std::vector<int64_t> encoder_shape;
+                Ort::Value encoder_states{nullptr};
+                // uncached path: encoder_states no longer matches `sequences`
+                bool stale_states = true;
+                // the chosen tokens of the batch, and on the cached path its cache and logits buffers
+                WhisperDecoder::Workspace workspace;
+            };
+
+            void loop();
+
+            std::size_t active_rows() const;
+            void admit(std::vector<Sequence> & arrivals);
+            void start_cohort(std::vector<Sequence> sequences, std::vector<int64_t> encoder_shape);
+            void step(Cohort & cohort);
+            // appends each row's token, completes finished rows or queues their
+            // next attempt, and drops them from the batch
+            void advance(Cohort & cohort, const WhisperDecoder::StepTokens & next);
+            // completes a stopped sequence and returns true, or readies its next
+            // attempt and returns false
+            bool finish_attempt(Sequence & sequence);
+            void fail(Cohort & cohort, std::exception_ptr error);
+            // an empty cohort's workspace back to the idle ones, or freed when there are enough
+            void retire(Cohort & cohort);
+
+            const WhisperDecoder & ds_decoder;
+            DecoderSchedulerOptions ds_options;
+
+            std::mutex ds_mutex;
+            std::condition_variable ds_cv;
+            std::deque<Sequence> ds_queue;
+            bool ds_stopping;
+
+            // only touched by the worker
+            std::vector<Cohort> ds_cohorts;
+            // sequences waiting to start their next attempt, admitted first
+            std::vector<Sequence> ds_retries;
+            // workspaces of finished cohorts, at most spare_workspaces
+            std::vector<WhisperDecoder::Workspace> ds_idle_workspaces;
+
+            Histogram ds_batch_sizes;
+            Histogram ds_wait_us;
+
+            // started last, after everything loop() touches is constructed
+            std::thread ds_worker;
+    };
+}
@@ -0,0 +1,65 @@
+//file:: fft.hpp
+#pragma once
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+
+namespace AIvoice{
+
+    // mixed-radix complex FFT plan (radix 4, 2, 5, 3 and a generic butterfly).
+    // the plan is immutable after construction and can be shared between threads.
+    class ComplexFFT{
+        public:
+            explicit ComplexFFT(std::size_t n);
+
+            std::size_t size() const;
+
+            // out-of-place forward transform, `input` and `output` hold size() values
+            void forward(const std::complex<float> * input, std::complex<float> * output) const;
+
+        private:
+            void work(std::complex<float> * out, const std::complex<float> * in, std::size_t stride, const std::size_t * factors) const;
+
+            void butterfly2(std::complex<float> * out, std::size_t stride, std::size_t m) const;
+            void butterfly4(std::complex<float> * out, std::size_t stride, std::size_t m) const;
+            void butterfly5(std::complex<float> * out, std::size_t stride, std::size_t m) const;
+            void butterfly_generic(std::complex<float> * out, std::size_t stride, std::size_t m, std::size_t p) const;
+
+            std::size_t c_n;
+            // pairs of (radix, remaining length) for each stage
+            std::vector<std::size_t> c_factors;
+            // exp(-2*pi*i*k/n)
+            std::vector<std::complex<float>> c_twiddles;
+    };
+
+    // FFT of n real samples (n even) through one complex FFT of n/2 points.
+    // for n = 400 that is a 200 point transform, factored as 4*2*5*5.
+    class RealFFT{
+        public:
+            // scratch for one transform at a time; keep one per thread
+            struct Workspace{
+                std::vector<std::complex<float>> packed;
+                std::vector<std::complex<float>> spectrum;
+            };
+
+            explicit RealFFT(std::size_t n);
+
+            std::size_t size() const;
+            std::size_t bins() const;
+
+            Workspace make_workspace() const;
+
+            // bins() = n/2 + 1 complex values
+            void forward(const float * input, std::complex<float> * output, Workspace & workspace) const;
+            // |X[k]| for the bins() non-negative frequencies
+            void magnitude(const float * input, float * output, Workspace & workspace) const;
+
+        private:
+            std::size_t r_n;
+            ComplexFFT r_half;
+            // exp(-2*pi*i*k/n) for k in [0, n/2]
+            std::vector<std::complex<float>> r_twiddles;
+    };
+}
@@ -0,0 +1,82 @@
+//file:: http_session.hpp
+#pragma once
+
+#include <memory>
+#include <deque>
+#include <chrono>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <optional>
+
+
+namespace AIvoice{
+
+    using HttpRequest = boost::beast::http::request<boost::beast::http::string_body>;
+    using HttpResponse = boost::beast::http::response<boost::beast::http::string_body>;
+
+    // called at most once per request, from any thread
+    using ResponseSender = std::function<void(HttpResponse &&)>;
+    using RequestHandler = std::function<void(HttpRequest &&, ResponseSender)>;
+
+    struct HttpSessionOptions{
+        // how long a keep-alive connection may sit without a request in flight
+        std::chrono::seconds idle_timeout{30};
+        // how long the body of a request may take once its header has arrived
+        std::chrono::seconds read_timeout{120};
+        std::chrono::seconds write_timeout{60};
+        std::uint64_t body_limit{256ull * 1024 * 1024};
+        // max requests read ahead of their responses on one connection
+        std::size_t pipeline_limit{8};
+    };
+
+    // one per accepted connection, keeps itself alive through its pending handlers
+    class HttpSession : public std::enable_shared_from_this<HttpSession>{
+        public:
+            HttpSession(boost::asio::ip::tcp::socket && socket, RequestHandler handler, const HttpSessionOptions & options);
+
+            void start();
+
+        private:
+
+            // a response slot, filled when the handler finishes; written in request order
+            struct Pending{
+                bool ready = false;
+                HttpResponse response;
+            };
+
+            enum class ReadState{ idle, header, body };
+
+            void do_read();
+            void on_header(boost::beast::error_code ec);
+            void on_read(boost::beast::error_code ec);
+            void on_read_error(boost::beast::error_code ec);
+
+            void dispatch(HttpRequest && req);
+            void enqueue_error(boost::beast::http::status status, unsigned int version);
+
+            void do_write();
+            void on_write(boost::beast::error_code ec, bool keep_alive);
+
+            void arm_idle_timer();
+            void arm_write_timer();
+            void do_close();
+
+            boost::beast::tcp_stream h_stream;
+            boost::beast::flat_buffer h_buffer;
+            std::optional<boost::beast::http::request_parser<boost::beast::http::string_body>> h_parser;
+            boost::asio::steady_timer h_idle_timer;
+            // the stream's own expiry bounds reads only: a write sharing it would
+            // replace the deadline of the read in flight beside it
+            boost::asio::steady_timer h_write_timer;
+
+            RequestHandler h_handler;
+            HttpSessionOptions h_options;
+
+            std::deque<std::shared_ptr<Pending>> h_queue;
+            ReadState h_read_state;
+            bool h_writing;
+            // set once a request asked for Connection: close or the peer went away
+            bool h_closing;
+    };
+}
@@ -0,0 +1,49 @@
+//file:: inference_executor.hpp
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <boost/asio/thread_pool.hpp>
+
+
+namespace AIvoice{
+
+    // compute pool for model inference, kept apart from the io_context threads.
+    // admission is bounded: once `threads + queue_depth` jobs are running or
+    // waiting, try_submit refuses instead of queueing without limit.
+    class InferenceExecutor{
+        public:
+            // a job's admission slot, freed once the last copy is gone. it may
+            // outlive the executor
+            using Admission = std::shared_ptr<void>;
+
+            InferenceExecutor(std::size_t threads, std::size_t queue_depth);
+            ~InferenceExecutor();
+
+            InferenceExecutor(const InferenceExecutor &) = delete;
+            InferenceExecutor & operator=(const InferenceExecutor &) = delete;
+
+            // returns false without running the job when the pool is saturated
+            bool try_submit(std::function<void()> job);
+            // for jobs that finish on another thread: the slot stays taken after
+            // `job` returns, for as long as it keeps a copy of its Admission
+            bool try_submit_async(std::function<void(Admission)> job);
+
+            std::size_t pending() const;
+            std::size_t capacity() const;
+            std::size_t threads() const;
+
+        private:
+            // takes a slot, false when there is none
+            bool admit();
+
+            std::size_t e_threads;
+            std::size_t e_capacity;
+            // shared with outstanding admissions
+            std::shared_ptr<std::atomic<std::size_t>> e_pending;
+
+            boost::asio::thread_pool e_pool;
+    };
+}
@@ -0,0 +1,73 @@
+//file:: logits_processor.hpp
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+
+namespace AIvoice{
+
+    // the token picked from one row of logits
+    struct TokenChoice{
+        int64_t token = 0;
+        // log-softmax of the token over the tokens that were not suppressed
+        float logprob = 0.0f;
+    };
+
+    // how a row's token is picked
+    struct SamplingOptions{
+        // 0 takes the most likely token; above 0 one of the top_k most likely
+        // is drawn from their softmax at this temperature
+        float temperature = 0.0f;
+        int top_k = 32;
+    };
+
+    // picks Whisper's next token from a row of logits in one pass over it:
+    // suppressed tokens are masked out, the log-softmax normalizer is summed
+    // online, the top-k candidates are kept, and the no-speech probability is
+    // read from the unmasked softmax when asked for. the pass runs on AVX-512
+    // or AVX2 when the CPU has them, picked once at construction, and on a
+    // scalar loop otherwise. read-only after construction, shared by all threads
+    class LogitsProcessor{
+        public:
+            enum class Kernel{
+                scalar,
+                avx2,
+                avx512
+            };
+
+            static constexpr int max_top_k = 64;
+
+            // nothing suppressed, no no-speech token
+            LogitsProcessor();
+            // masks cover token ids below `vocab_size`; rows may be longer, their
+            // extra tokens are never suppressed. `suppressed_at_begin` is masked
+            // in addition for the first generated token. no_speech_token < 0 has none
+            LogitsProcessor(int64_t vocab_size, const std::vector<int64_t> & suppressed, const std::vector<int64_t> & suppressed_at_begin, int64_t no_speech_token);
+
+            // the fastest kernel this CPU runs
+            static Kernel best_kernel();
+            static bool supported(Kernel kernel);
+            static const char * name(Kernel kernel);
+
+            Kernel kernel() const;
+            // another supported kernel, for comparing them
+            void set_kernel(Kernel kernel);
+
+            // the next token from `vocab_size` logits. `first_token` also masks the
+            // at-begin tokens, `uniform` in [0, 1) drives sampling and is unused at
+            // temperature 0. `no_speech_prob`, when not null, receives the no-speech
+            // token's probability under the unmasked softmax (0 without one)
+            TokenChoice choose(const float * logits, int64_t vocab_size, bool first_token, const SamplingOptions & sampling, float uniform, float * no_speech_prob) const;
+            // the no-speech token's probability alone, for a row no token is picked from
+            float no_speech_prob(const float * logits, int64_t vocab_size) const;
+
+        private:
+            Kernel lp_kernel;
+            int64_t lp_vocab_size;
+            // 0 for allowed tokens, -inf for suppressed ones, added to the logits
+            std::vector<float> lp_mask;
+            std::vector<float> lp_begin_mask;
+            int64_t lp_no_speech_token;
+    };
+}
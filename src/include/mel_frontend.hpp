@@ -0,0 +1,72 @@
+//file:: mel_frontend.hpp
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "fft.hpp"
+#include "parallel.hpp"
+
+
+namespace AIvoice{
+
+    // log-mel spectrogram for the Whisper encoder: hann window, real FFT magnitude,
+    // triangular mel filters, log. window, FFT plan and filters are built once
+    // and shared; per-call state lives in a Workspace (one per thread).
+    class MelFrontend{
+        public:
+            struct Workspace{
+                RealFFT::Workspace fft;
+                std::vector<float> frame;
+                std::vector<float> magnitude;
+                // block_frames rows of n_mel values, transposed into the output per block
+                std::vector<float> time_major;
+            };
+
+            MelFrontend(int sample_rate, int n_fft, int hop_length, int n_mel);
+
+            int n_mel() const;
+            int n_fft() const;
+            int hop_length() const;
+
+            // frames produced from `sample_count` samples (0 when shorter than one window)
+            int time_steps(std::size_t sample_count) const;
+
+            Workspace make_workspace() const;
+
+            // writes the [n_mel, time_steps] spectrogram of `samples`, mel-major as
+            // the encoder's [1, 80, T] input expects
+            void compute(const float * samples, std::size_t sample_count, float * output, Workspace & workspace) const;
+
+            // compute() with the frames split over up to workspaces.size() threads,
+            // the calling one and those of `pool`, each on its own workspace. short
+            // inputs stay on fewer threads
+            void compute_parallel(const float * samples, std::size_t sample_count, float * output, std::vector<Workspace> & workspaces, WorkerPool & pool) const;
+
+            // frames [frame_begin, frame_end) of the same spectrogram; `output` is
+            // still the whole [n_mel, time_steps] buffer, only those columns are written
+            void compute_frames(const float * samples, int time_steps, int frame_begin, int frame_end, float * output, Workspace & workspace) const;
+
+        private:
+            // frames computed time-major before one transpose into the output
+            static constexpr int block_frames = 32;
+            // a helper thread is only worth using for at least this many blocks
+            static constexpr int min_blocks_per_worker = 4;
+
+            void build_filters(int sample_rate);
+
+            int m_n_fft;
+            int m_hop_length;
+            int m_n_mel;
+
+            RealFFT m_fft;
+            std::vector<float> m_window;
+
+            // filter i covers bins [m_filter_start[i], m_filter_start[i] + m_filter_length[i])
+            // with weights m_filter_weights[m_filter_offset[i] ...]
+            std::vector<int> m_filter_start;
+            std::vector<int> m_filter_length;
+            std::vector<std::size_t> m_filter_offset;
+            std::vector<float> m_filter_weights;
+    };
+}
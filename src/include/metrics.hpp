@@ -0,0 +1,31 @@
+//file:: metrics.hpp
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+
+
+namespace AIvoice{
+
+    // fixed-bucket histogram, safe to record into from any thread
+    class Histogram{
+        public:
+            // upper bounds of each bucket, ascending; one overflow bucket is added
+            explicit Histogram(std::vector<double> bounds);
+
+            void record(double value);
+
+            // {"bounds": [...], "counts": [...], "count": n, "sum": s}
+            nlohmann::json to_json() const;
+
+        private:
+            std::vector<double> m_bounds;
+            std::unique_ptr<std::atomic<uint64_t>[]> m_counts;
+            std::atomic<uint64_t> m_count;
+            std::atomic<double> m_sum;
+    };
+}
@@ -0,0 +1,183 @@
+//file:: micro_batcher.hpp
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+#include "metrics.hpp"
+
+
+namespace AIvoice{
+
+    struct MicroBatcherOptions{
+        std::size_t max_batch = 8;
+        // how long the oldest queued item may wait for company
+        std::chrono::microseconds max_wait{3000};
+    };
+
+    // gathers items submitted from many threads into one call of `runner`.
+    // a batch is run once max_batch items are queued or the oldest has waited
+    // max_wait, whichever comes first. `runner` gets the items in submission
+    // order and must return one result per item.
+    // a submitter that blocks on its future holds back one item per blocked
+    // thread; submit with a Completion to let batches fill past that.
+    template<typename Item, typename Result>
+    class MicroBatcher{
+        public:
+            using Runner = std::function<std::vector<Result>(std::vector<Item> &)>;
+            // runs on the batcher's worker with the item's ready future, after
+            // the whole batch is done. it must not throw or block
+            using Completion = std::function<void(std::future<Result>)>;
+
+            MicroBatcher(Runner runner, const MicroBatcherOptions & options)
+            : b_runner(std::move(runner)), b_options(sanitize(options)), b_stopping(false),
+            b_batch_sizes({1, 2, 4, 8, 16, 32, 64, 128}),
+            b_wait_us({100, 250, 500, 1000, 2000, 5000, 10000, 50000}),
+            b_worker([this](){ loop(); })
+            {
+            }
+
+            ~MicroBatcher(){
+                {
+                    std::lock_guard<std::mutex> lock(b_mutex);
+                    b_stopping = true;
+                }
+                b_cv.notify_all();
+                b_worker.join();
+            }
+
+            MicroBatcher(const MicroBatcher &) = delete;
+            MicroBatcher & operator=(const MicroBatcher &) = delete;
+
+            std::future<Result> submit(Item item){
+                Entry entry{std::move(item), std::promise<Result>(), Completion(), std::chrono::steady_clock::now()};
+                std::future<Result> result = entry.promise.get_future();
+                enqueue(std::move(entry));
+                return result;
+            }
+
+            void submit(Item item, Completion done){
+                enqueue(Entry{std::move(item), std::promise<Result>(), std::move(done), std::chrono::steady_clock::now()});
+            }
+
+            std::size_t max_batch() const{
+                return b_options.max_batch;
+            }
+
+            // batch size and per-item queueing delay, for tuning max_batch/max_wait
+            nlohmann::json stats() const{
+                nlohmann::json res_json;
+                res_json["max_batch"] = b_options.max_batch;
+                res_json["max_wait_us"] = b_options.max_wait.count();
+                res_json["batch_size"] = b_batch_sizes.to_json();
+                res_json["wait_us"] = b_wait_us.to_json();
+                return res_json;
+            }
+
+        private:
+            static MicroBatcherOptions sanitize(MicroBatcherOptions options){
+                if(options.max_batch == 0){
+                    options.max_batch = 1;
+                }
+                return options;
+            }
+
+            struct Entry{
+                Item item;
+                std::promise<Result> promise;
+                // set for items submitted with a completion instead of a future
+                Completion done;
+                std::chrono::steady_clock::time_point enqueued;
+            };
+
+            void enqueue(Entry entry){
+                {
+                    std::lock_guard<std::mutex> lock(b_mutex);
+                    b_queue.push_back(std::move(entry));
+                }
+                b_cv.notify_one();
+            }
+
+            void loop(){
+                std::unique_lock<std::mutex> lock(b_mutex);
+                while(true){
+                    b_cv.wait(lock, [this](){ return b_stopping || !b_queue.empty(); });
+                    if(b_queue.empty()){
+                        return;
+                    }
+
+                    auto deadline = b_queue.front().enqueued + b_options.max_wait;
+                    b_cv.wait_until(lock, deadline, [this](){
+                        return b_stopping || b_queue.size() >= b_options.max_batch;
+                    });
+
+                    std::size_t count = std::min(b_queue.size(), b_options.max_batch);
+                    std::vector<Entry> batch;
+                    batch.reserve(count);
+                    for(std::size_t i = 0; i < count; ++i){
+                        batch.push_back(std::move(b_queue.front()));
+                        b_queue.pop_front();
+                    }
+
+                    lock.unlock();
+                    run_batch(batch);
+                    lock.lock();
+                }
+            }
+
+            void run_batch(std::vector<Entry> & batch){
+                auto started = std::chrono::steady_clock::now();
+                b_batch_sizes.record(static_cast<double>(batch.size()));
+
+                std::vector<Item> items;
+                items.reserve(batch.size());
+                for(auto & entry : batch){
+                    b_wait_us.record(std::chrono::duration<double, std::micro>(started - entry.enqueued).count());
+                    items.push_back(std::move(entry.item));
+                }
+
+                try{
+                    std::vector<Result> results = b_runner(items);
+                    if(results.size() != batch.size()){
+                        throw std::runtime_error("batch runner returned the wrong number of results");
+                    }
+                    for(std::size_t i = 0; i < batch.size(); ++i){
+                        batch[i].promise.set_value(std::move(results[i]));
+                    }
+                }catch(...){
+                    for(auto & entry : batch){
+                        entry.promise.set_exception(std::current_exception());
+                    }
+                }
+
+                for(auto & entry : batch){
+                    if(entry.done){
+                        entry.done(entry.promise.get_future());
+                    }
+                }
+            }
+
+            Runner b_runner;
+            MicroBatcherOptions b_options;
+
+            std::mutex b_mutex;
+            std::condition_variable b_cv;
+            std::deque<Entry> b_queue;
+            bool b_stopping;
+
+            Histogram b_batch_sizes;
+            Histogram b_wait_us;
+
+            // started last, after everything loop() touches is constructed
+            std::thread b_worker;
+    };
+}
@@ -0,0 +1,25 @@
+//file:: multipart.hpp
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace AIvoice{
+
+    // one part of a multipart/form-data body, views into the request buffer
+    struct MultipartPart{
+        std::string name;
+        std::string filename;
+        std::string content_type;
+        std::string_view data;
+    };
+
+    // returns the boundary of a multipart/form-data content type, or "" if it is not one
+    std::string multipart_boundary(std::string_view content_type);
+
+    // splits a multipart body into its parts, in order.
+    // throws std::invalid_argument when the body does not follow the boundary
+    std::vector<MultipartPart> parse_multipart(std::string_view body, const std::string & boundary);
+}
@@ -0,0 +1,111 @@
+//file:: parallel.hpp
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace AIvoice{
+
+    // a fixed set of threads shared by every caller of parallel_for, created
+    // once instead of per call. tasks never wait on each other, so callers
+    // from any number of threads cannot deadlock it
+    class WorkerPool{
+        public:
+            explicit WorkerPool(std::size_t threads);
+            ~WorkerPool();
+
+            WorkerPool(const WorkerPool &) = delete;
+            WorkerPool & operator=(const WorkerPool &) = delete;
+
+            std::size_t threads() const;
+            void post(std::function<void()> task);
+
+        private:
+            void loop();
+
+            std::mutex p_mutex;
+            std::condition_variable p_cv;
+            std::deque<std::function<void()>> p_tasks;
+            bool p_stopping;
+
+            // started last, after everything loop() touches is constructed
+            std::vector<std::thread> p_threads;
+    };
+
+    // splits [0, count) into contiguous ranges and calls fn(worker, begin, end)
+    // for each, on the calling thread plus up to max_workers - 1 threads of
+    // `pool`. the caller takes ranges too, so a pool busy with other callers
+    // only means fewer helpers. `worker` is in [0, max_workers) and no two
+    // ranges run on the same one at once, so callers can keep per-worker scratch.
+    // the first exception thrown by any range is rethrown after all have finished.
+    template<typename Fn>
+    void parallel_for(WorkerPool & pool, std::size_t count, std::size_t max_workers, Fn && fn){
+        if(count == 0){
+            return;
+        }
+        const std::size_t workers = std::max<std::size_t>(1, std::min({max_workers, count, pool.threads() + 1}));
+        if(workers == 1){
+            fn(std::size_t{0}, std::size_t{0}, count);
+            return;
+        }
+
+        // outlives this call in helpers the pool starts late; those find no
+        // range left and never touch `fn`
+        struct Ranges{
+            std::atomic<std::size_t> next{0};
+            std::size_t total = 0;
+            std::size_t finished = 0;
+            std::mutex mutex;
+            std::condition_variable cv;
+            std::vector<std::exception_ptr> errors;
+            std::function<void(std::size_t worker, std::size_t range)> run;
+        };
+        auto ranges = std::make_shared<Ranges>();
+        ranges->total = workers;
+        ranges->errors.resize(workers);
+        ranges->run = [&fn, count, workers](std::size_t worker, std::size_t range){
+            fn(worker, count * range / workers, count * (range + 1) / workers);
+        };
+
+        auto run_ranges = [](Ranges & state, std::size_t worker){
+            for(std::size_t range = state.next.fetch_add(1); range < state.total; range = state.next.fetch_add(1)){
+                try{
+                    state.run(worker, range);
+                }catch(...){
+                    state.errors[range] = std::current_exception();
+                }
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if(++state.finished == state.total){
+                    state.cv.notify_all();
+                }
+            }
+        };
+
+        for(std::size_t worker = 1; worker < workers; ++worker){
+            pool.post([ranges, worker, run_ranges](){
+                run_ranges(*ranges, worker);
+            });
+        }
+        run_ranges(*ranges, 0);
+        {
+            std::unique_lock<std::mutex> lock(ranges->mutex);
+            ranges->cv.wait(lock, [&](){ return ranges->finished == ranges->total; });
+        }
+
+        for(auto & error : ranges->errors){
+            if(error){
+                std::rethrow_exception(error);
+            }
+        }
+    }
+}
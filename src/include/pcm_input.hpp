@@ -0,0 +1,53 @@
+//file:: pcm_input.hpp
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+
+
+namespace AIvoice{
+
+    enum class SampleEncoding{
+        u8,
+        s16le,
+        s16be,
+        s24le,
+        s32le,
+        f32le
+    };
+
+    struct PcmFormat{
+        SampleEncoding encoding;
+        int sample_rate;
+        int channels;
+
+        // bytes of one interleaved frame, every channel
+        std::size_t frame_bytes() const;
+    };
+
+    // uncompressed interleaved samples and how to read them, `payload` points
+    // into the caller's buffer and holds whole frames only
+    struct PcmAudio{
+        PcmFormat format;
+        std::span<const unsigned char> payload;
+
+        std::size_t frames() const;
+    };
+
+    // RIFF/WAVE holding integer PCM or 32-bit float, WAVE_FORMAT_EXTENSIBLE
+    // included. nothing for any other codec or a malformed header, those go
+    // through FFmpeg
+    std::optional<PcmAudio> parse_wav(std::span<const unsigned char> bytes);
+
+    // raw PCM content types: audio/L16 (big-endian, RFC 3551) and
+    // audio/pcm, audio/x-pcm, audio/raw with optional rate, channels and
+    // format (u8, s16le, s16be, s24le, s32le, f32le) parameters; 16 kHz mono
+    // s16le unless stated. nothing for any other type
+    std::optional<PcmFormat> parse_pcm_content_type(std::string_view content_type);
+
+    // `frames` interleaved frames from `data` to mono float in [-1, 1),
+    // channels averaged
+    void pcm_to_mono_float(const PcmFormat & format, const unsigned char * data, std::size_t frames, float * output);
+}
@@ -0,0 +1,45 @@
+//file:: resampler.hpp
+#pragma once
+
+#include <vector>
+
+struct AVChannelLayout;
+struct AVFrame;
+struct SwrContext;
+
+
+namespace AIvoice{
+
+    // converts decoded audio frames of any sample format, channel layout and
+    // rate to mono float at one output rate, through libswresample. the context
+    // is rebuilt only when the input format changes, and the output vector is
+    // reused across frames so steady-state conversion does not allocate.
+    class AudioResampler{
+        public:
+            explicit AudioResampler(int output_rate);
+            ~AudioResampler();
+
+            AudioResampler(const AudioResampler &) = delete;
+            AudioResampler & operator=(const AudioResampler &) = delete;
+
+            // `output` holds the frame's converted samples afterwards, false on failure.
+            // a resampling context keeps a few samples back, flush() returns them
+            bool convert(const AVFrame * frame, std::vector<float> & output);
+            // mono float at `input_rate`, for PCM that did not come through a decoder
+            bool convert(const float * samples, int count, int input_rate, std::vector<float> & output);
+            // whatever the context still holds, at the end of the stream
+            bool flush(std::vector<float> & output);
+
+        private:
+            // (re)builds the context when the format, rate or channel count changes.
+            // `layout` may be null for mono
+            bool configure(int format, int rate, const AVChannelLayout * layout, int channels, std::vector<float> & output);
+            bool drain(const unsigned char ** input, int input_samples, std::vector<float> & output);
+
+            const int rs_output_rate;
+            SwrContext * rs_context;
+            int rs_input_format;
+            int rs_input_rate;
+            int rs_input_channels;
+    };
+}
@@ -11,16 +11,24 @@
 #include <numeric>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <thread>
 
 #include "ai_manager.hpp"
+#include "http_session.hpp"
+#include "inference_executor.hpp"
+#include "config.hpp"
+#include "multipart.hpp"
 
 
 namespace AIvoice{
     class Server{
         public:
-            Server(std::string ipaddr, unsigned int port, int threads);
+            explicit Server(const ServerConfig & config);
 
 
+            // blocks until SIGINT/SIGTERM, running the io_context on config.io_threads threads
             void run();
 
 
@@ -28,20 +36,58 @@ namespace AIvoice{
 
             void do_accept();
 
-            void handle_request(
-                boost::beast::http::request<boost::beast::http::string_body> && req,
-                boost::beast::tcp_stream & stream
+            void handle_request(HttpRequest && req, ResponseSender send);
+
+            // runs `handler` on the inference pool, or answers 503 when it is full
+            void submit_inference(
+                HttpRequest && req,
+                ResponseSender send,
+                HttpResponse (Server::*handler)(const std::shared_ptr<const HttpRequest> &)
+            );
+
+            // 503 with Retry-After, the pool is full
+            void send_busy(const HttpRequest & req, const ResponseSender & send);
+
+            // like submit_inference, for handlers that answer from another thread
+            // later: the request keeps its admission slot until `send` is done with
+            void submit_inference_async(
+                HttpRequest && req,
+                ResponseSender send,
+                void (Server::*handler)(const std::shared_ptr<const HttpRequest> &, ResponseSender)
+            );
+
+            // answers from the image batcher's continuation, no pool thread waits for the batch
+            void handle_upload(const std::shared_ptr<const HttpRequest> & req, ResponseSender send);
+            HttpResponse handle_upload_batch(const std::shared_ptr<const HttpRequest> & req);
+            HttpResponse handle_transcribe(const std::shared_ptr<const HttpRequest> & req);
+
+            // queues a copy of the body for the upload writer and returns its file
+            // name, or an empty string when persistence is off or the writer is behind
+            std::string persist_upload(const std::shared_ptr<const HttpRequest> & req, const std::string & prefix, const std::string & extension);
+
+            static HttpResponse make_json_response(
+                boost::beast::http::status status,
+                const nlohmann::json & res_json,
+                const HttpRequest & req
             );
 
             boost::asio::ip::tcp::endpoint s_make_endpoint();
 
+            ServerConfig s_config;
             std::string s_ipaddr;
             unsigned int s_port;
 
 
             boost::asio::io_context s_ioc;
             boost::asio::ip::tcp::acceptor s_acceptor;
+            boost::asio::signal_set s_signals;
 
             AIManager s_ai_manager;
+            // single thread that writes persisted uploads, bounded like the inference pool
+            InferenceExecutor s_upload_writer;
+            // appended to upload filenames, uploads in the same millisecond get different names
+            std::atomic<std::uint64_t> s_upload_count;
+            // declared last so its threads are joined before the model and writer go away
+            InferenceExecutor s_executor;
     };
 }
\ No newline at end of file
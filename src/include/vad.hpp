@@ -0,0 +1,75 @@
+//file:: vad.hpp
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <onnxruntime/onnxruntime_cxx_api.h>
+
+#include "fft.hpp"
+
+
+namespace AIvoice{
+
+    struct VadOptions{
+        bool enabled = true;
+        // Silero VAD onnx model, empty uses the energy/spectral detector
+        std::string model_path;
+
+        // energy gate: a frame must be this far above the file's noise floor
+        // (its 10th percentile frame energy), clamped to [min_db, max_db] dBFS
+        float margin_db = 10.0f;
+        float min_db = -60.0f;
+        float max_db = -35.0f;
+
+        // speech probability threshold when a VAD model is loaded
+        float model_threshold = 0.5f;
+
+        // smoothing: shorter pauses are bridged, shorter bursts dropped,
+        // and every region is widened by padding_ms on both sides
+        int min_silence_ms = 300;
+        int min_speech_ms = 200;
+        int padding_ms = 300;
+    };
+
+    // [begin, end) in samples
+    struct SpeechRegion{
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    // finds the speech in 16 kHz mono PCM, in frames of 512 samples (32 ms).
+    // without a model a frame is speech when it is loud enough and either
+    // voiced (tonal, most energy in the 300-3400 Hz band) or fricative (high
+    // zero crossing rate, not fully noise-like). with a Silero VAD export
+    // (v4 h/c or v5 state inputs) its per-frame probability decides instead.
+    class VoiceActivityDetector{
+        public:
+            // `model` may be null; it must outlive the detector
+            VoiceActivityDetector(const VadOptions & options, Ort::Session * model);
+
+            // sorted, non-overlapping regions
+            std::vector<SpeechRegion> detect(const float * samples, std::size_t count) const;
+
+            // "energy" or "model"
+            const char * method() const;
+
+        private:
+            static constexpr int sample_rate = 16000;
+            static constexpr std::size_t frame_size = 512;
+
+            std::vector<bool> classify_by_features(const float * samples, std::size_t count) const;
+            std::vector<bool> classify_by_model(const float * samples, std::size_t count) const;
+            std::vector<SpeechRegion> smooth(const std::vector<bool> & speech_frames, std::size_t count) const;
+
+            VadOptions v_options;
+            Ort::Session * v_model;
+            // v5 exports carry one "state" tensor and want 64 samples of context
+            bool v_model_has_state;
+            // "sr" is a scalar in some exports and [1] in others
+            std::size_t v_sr_rank;
+
+            RealFFT v_fft;
+            std::vector<float> v_window;
+    };
+}
@@ -0,0 +1,195 @@
+//file:: whisper_decoder.hpp
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include <onnxruntime/onnxruntime_cxx_api.h>
+
+#include "decode_guard.hpp"
+#include "logits_processor.hpp"
+
+
+namespace AIvoice{
+
+    // greedy Whisper decoding over one encoder output.
+    // with a decoder_with_past export the self-attention K/V is carried from
+    // present.* to past_key_values.* between steps and the cross-attention K/V
+    // of the first step is reused for the whole chunk, so every later step
+    // feeds a single token. without one, each step reruns the whole prefix.
+    // a decoder rewritten by tools/trim_decoder_logits.py takes last_positions
+    // and only projects those positions onto the vocabulary; it is fed when present.
+    // tokens are picked from the logits by a LogitsProcessor, which also
+    // scores them and reads the no-speech probability of the first token.
+    // decode() watches each attempt with a DecodeGuard and samples again at
+    // the fallback temperatures when one is stopped early.
+    class WhisperDecoder{
+        public:
+            // what one step picked for each row, pointing into the workspace
+            // until its next step. no_speech_probs is 0 for rows that are past
+            // their first token
+            struct StepTokens{
+                std::span<const int64_t> tokens;
+                std::span<const float> logprobs;
+                std::span<const float> no_speech_probs;
+            };
+
+            // buffers of the cached step loop for one batch of rows. decoder_with_past
+            // reads and writes them through an IoBinding: token ids and logits sit in
+            // fixed buffers, each self attention K/V alternates between two buffers
+            // sized for the longest sequence, and the tensor views over them are made
+            // once per (rows, length) and kept. a step on a warmed-up workspace
+            // allocates nothing itself. first_step sizes it, later batches reuse it;
+            // one per decoding loop, never shared between threads
+            class Workspace{
+                public:
+                    Workspace();
+
+                    // drops the batch's tensors and bindings, keeps the buffers
+                    void release();
+
+                private:
+                    friend class WhisperDecoder;
+
+                    struct SelfEntry{
+                        int64_t heads = 0;
+                        int64_t head_dim = 0;
+                        std::array<std::vector<float>, 2> buffers;
+                        // [rows, heads, length, head_dim] over each buffer, at length * max_rows + rows - 1
+                        std::array<std::vector<Ort::Value>, 2> views;
+                    };
+
+                    // the session `binding` was made for
+                    Ort::Session * session = nullptr;
+                    Ort::IoBinding binding{nullptr};
+                    Ort::MemoryInfo memory_info;
+                    Ort::RunOptions run_options;
+
+                    // what the buffers have room for
+                    size_t max_rows = 0;
+                    int64_t max_length = 0;
+                    int64_t vocab_size = 0;
+
+                    // the batch being decoded, its cache length and which buffer holds it
+                    size_t rows = 0;
+                    int64_t length = 0;
+                    int current = 0;
+
+                    // input_ids of the next step, overwritten with its chosen tokens
+                    std::vector<int64_t> tokens;
+                    std::vector<float> logprobs;
+                    std::vector<float> no_speech_probs;
+                    // sampling temperature of each row, 0 is greedy
+                    std::vector<float> temperatures;
+                    std::mt19937 rng;
+                    std::vector<float> logits;
+                    // [rows, 1] and [rows, 1, vocab] views, at rows - 1
+                    std::vector<Ort::Value> token_views;
+                    std::vector<Ort::Value> logits_views;
+                    // in d_self_attention order
+                    std::vector<SelfEntry> self_entries;
+                    // cross attention K/V of the first step by past entry, null for self attention
+                    std::vector<Ort::Value> cross_entries;
+            };
+
+            // `decoder_with_past` may be null; both sessions must outlive the decoder.
+            // the default processor takes the plain argmax
+            WhisperDecoder(Ort::Session & decoder, Ort::Session * decoder_with_past, LogitsProcessor logits = LogitsProcessor());
+
+            // true when the cached path is available
+            bool uses_cache() const;
+
+            // attempts over `prompt` until one is not stopped early by `guard`: greedy
+            // first, then sampling at each fallback temperature. the best attempt is kept
+            DecodeResult decode(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length, const DecodeGuardOptions & guard, Workspace & workspace) const;
+
+            // tokens generated after `prompt`, including `eot` when it was produced
+            // within max_length steps. a negative eot never stops early
+            std::vector<int64_t> greedy(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length) const;
+            // the same on a workspace kept between calls
+            std::vector<int64_t> greedy(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length, Workspace & workspace) const;
+
+            // the uncached loop, whatever models are loaded
+            std::vector<int64_t> greedy_full(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length) const;
+
+            // single steps over `rows` sequences decoded in lockstep, used by greedy()
+            // and by DecoderScheduler. `encoder_states` is [rows, frames, dim] and
+            // each call returns the next token of every row, valid until the
+            // workspace's next step. `temperatures` holds each row's sampling
+            // temperature, empty decodes every row greedily
+
+            // [rows, prompt_length] row-major prompts through the plain decoder (cached
+            // path only), each starting with the start of transcript. fills `workspace` for up to max_length tokens per row and
+            // binds `encoder_states` for the later steps when steps_need_encoder_states(),
+            // the caller keeps it alive until then
+            StepTokens first_step(const Ort::Value & encoder_states, std::vector<int64_t> & input_ids, size_t rows, int max_length, std::span<const float> temperatures, Workspace & workspace) const;
+            // the previous step's token of every row through decoder_with_past
+            StepTokens next_step(Workspace & workspace) const;
+            // keeps `rows` (ascending) of the workspace batch, in that order.
+            // `encoder_states` is the caller's tensor already cut down to them
+            void keep_rows(const std::vector<size_t> & rows, const Ort::Value & encoder_states, Workspace & workspace) const;
+            // uncached step over right-padded [rows, length] input_ids. attention is
+            // causal, so row r's logits at last_positions[r] ignore the padding after it.
+            // row r picks its first token when last_positions[r] + 1 == prompt_lengths[r]
+            StepTokens full_step(const Ort::Value & encoder_states, std::vector<int64_t> & input_ids, size_t rows, const std::vector<int64_t> & last_positions, const std::vector<int64_t> & prompt_lengths, std::span<const float> temperatures, Workspace & workspace) const;
+
+            // false when decoder_with_past only reads the cross attention cache
+            bool steps_need_encoder_states() const;
+
+            const LogitsProcessor & logits_processor() const;
+
+            // float tensors joined along their first dimension
+            static Ort::Value concat_rows(const std::vector<const Ort::Value *> & tensors);
+            // `rows` of a float tensor along its first dimension, in that order
+            static Ort::Value select_rows(const Ort::Value & tensor, const std::vector<size_t> & rows);
+
+        private:
+            // attempt `number` (0 is the greedy one) at `temperature`, stopped by `guard`
+            DecodeResult attempt(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length, int number, float temperature, const DecodeGuardOptions & guard, Workspace & workspace) const;
+
+            // input_ids, encoder_hidden_states and, when taken, [rows, k] row-major
+            // `positions` as last_positions through the plain decoder; a decoder
+            // without that input ignores them and returns every position
+            std::vector<Ort::Value> run_decoder(const Ort::Value & encoder_states, std::vector<int64_t> & input_ids, size_t rows, const std::vector<int64_t> & positions, const std::vector<const char*> & output_names) const;
+
+            // checks both exports agree on the cache tensors, fills the name tables
+            bool detect_cache_layout();
+
+            // grows the workspace buffers for the first step's `outputs` when they do not fit
+            void prepare_workspace(Workspace & workspace, const std::vector<Ort::Value> & outputs, size_t rows, int64_t max_length) const;
+            // binds what stays fixed while the batch keeps its rows
+            void bind_batch(Workspace & workspace, const Ort::Value & encoder_states) const;
+            // views over the workspace buffers, made on first use
+            Ort::Value & self_view(Workspace & workspace, size_t entry, int buffer, int64_t length) const;
+            Ort::Value & token_view(Workspace & workspace) const;
+            Ort::Value & logits_view(Workspace & workspace) const;
+            // each row's token from [rows, length, vocab_size] logits at positions[row],
+            // at length - 1 when positions is null. first_token[row] marks a row's
+            // first generated token, null when no row is at it; such rows also read
+            // the no-speech probability at position 0, the start of transcript.
+            // null temperatures decode greedily
+            StepTokens choose_tokens(const float * logits, size_t rows, int64_t length, int64_t vocab_size, const int64_t * positions, const uint8_t * first_token, const float * temperatures, Workspace & workspace) const;
+
+            Ort::Session & d_decoder;
+            Ort::Session * d_decoder_with_past;
+            LogitsProcessor d_logits;
+
+            // past_key_values.* inputs of decoder_with_past, in its input order
+            std::vector<std::string> d_past_names;
+            // the matching present.* outputs of the first-step decoder
+            std::vector<std::string> d_present_names;
+            // past entries decoder_with_past updates every step (self attention);
+            // the others are the cross attention K/V and stay fixed for the chunk
+            std::vector<size_t> d_self_attention;
+            // decoder_with_past still takes encoder_hidden_states
+            bool d_with_past_takes_encoder;
+            // the plain decoder takes last_positions and returns [rows, 1, vocab] logits
+            bool d_decoder_takes_positions;
+
+            // logits and every present.* output of the first step
+            std::vector<const char*> d_first_output_names;
+    };
+}
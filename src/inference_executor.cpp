@@ -0,0 +1,77 @@
+//file:: inference_executor.cpp
+#include "include/inference_executor.hpp"
+
+#include <iostream>
+#include <exception>
+#include <boost/asio/post.hpp>
+
+
+namespace AIvoice{
+
+    InferenceExecutor::InferenceExecutor(std::size_t threads, std::size_t queue_depth)
+    : e_threads(threads == 0 ? 1 : threads), e_capacity(e_threads + queue_depth),
+    e_pending(std::make_shared<std::atomic<std::size_t>>(0)), e_pool(e_threads)
+    {
+    }
+
+    InferenceExecutor::~InferenceExecutor(){
+        e_pool.join();
+    }
+
+    bool InferenceExecutor::admit(){
+        std::size_t current = e_pending->load(std::memory_order_relaxed);
+        do{
+            if(current >= e_capacity){
+                return false;
+            }
+        }while(!e_pending->compare_exchange_weak(current, current + 1, std::memory_order_acq_rel));
+        return true;
+    }
+
+    bool InferenceExecutor::try_submit(std::function<void()> job){
+        if(!admit()){
+            return false;
+        }
+
+        boost::asio::post(e_pool, [this, job = std::move(job)](){
+            try{
+                job();
+            }catch(const std::exception & e){
+                std::cerr << "Error in inference job: " << e.what() << std::endl;
+            }
+            e_pending->fetch_sub(1, std::memory_order_acq_rel);
+        });
+        return true;
+    }
+
+    bool InferenceExecutor::try_submit_async(std::function<void(Admission)> job){
+        if(!admit()){
+            return false;
+        }
+
+        //the deleter runs on a null pointer too, when the last copy goes
+        Admission admission(nullptr, [pending = e_pending](void *){
+            pending->fetch_sub(1, std::memory_order_acq_rel);
+        });
+        boost::asio::post(e_pool, [job = std::move(job), admission = std::move(admission)]() mutable{
+            try{
+                job(std::move(admission));
+            }catch(const std::exception & e){
+                std::cerr << "Error in inference job: " << e.what() << std::endl;
+            }
+        });
+        return true;
+    }
+
+    std::size_t InferenceExecutor::pending() const{
+        return e_pending->load(std::memory_order_relaxed);
+    }
+
+    std::size_t InferenceExecutor::capacity() const{
+        return e_capacity;
+    }
+
+    std::size_t InferenceExecutor::threads() const{
+        return e_threads;
+    }
+}
@@ -0,0 +1,391 @@
+//file:: logits_processor.cpp
+#include "include/logits_processor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define AIVOICE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+
+namespace AIvoice{
+
+    namespace{
+
+        constexpr float lowest = std::numeric_limits<float>::lowest();
+        constexpr float negative_infinity = -std::numeric_limits<float>::infinity();
+
+        // running max and sum of exp(x - max). starting from the lowest finite
+        // float instead of -inf keeps exp(old - new) away from -inf - -inf
+        struct Softmax{
+            float max = lowest;
+            float sum = 0.0f;
+
+            void add(float value){
+                if(value > max){
+                    sum = sum * std::exp(max - value) + 1.0f;
+                    max = value;
+                }else{
+                    sum += std::exp(value - max);
+                }
+            }
+
+            void merge(float other_max, float other_sum){
+                const float new_max = std::max(max, other_max);
+                sum = sum * std::exp(max - new_max) + other_sum * std::exp(other_max - new_max);
+                max = new_max;
+            }
+
+            float log_sum() const{
+                return max + std::log(sum);
+            }
+        };
+
+        // the k largest values seen, in descending order. ties keep the lower
+        // token id first, so k = 1 agrees with std::max_element
+        struct TopK{
+            int k;
+            int count = 0;
+            float values[LogitsProcessor::max_top_k];
+            int64_t ids[LogitsProcessor::max_top_k];
+
+            explicit TopK(int k) : k(k){}
+
+            // values must beat this to enter
+            float threshold() const{
+                return count < k ? negative_infinity : values[k - 1];
+            }
+
+            void insert(float value, int64_t id){
+                if(!(value > threshold())){
+                    return;
+                }
+                int pos = count < k ? count++ : k - 1;
+                while(pos > 0 && values[pos - 1] < value){
+                    values[pos] = values[pos - 1];
+                    ids[pos] = ids[pos - 1];
+                    --pos;
+                }
+                values[pos] = value;
+                ids[pos] = id;
+            }
+        };
+
+        struct Scan{
+            // over the masked logits, for log-probabilities
+            Softmax masked;
+            // over the raw logits, for the no-speech probability
+            Softmax raw;
+            TopK top;
+
+            explicit Scan(int k) : top(k){}
+        };
+
+        // the scan of logits[0, size), whose token ids start at `first_id`.
+        // `mask` is added to the logits when Masked, the raw softmax is only kept when Raw
+        template<bool Masked, bool Raw>
+        void scan_scalar(const float * logits, const float * mask, std::size_t size, int64_t first_id, Scan & scan){
+            for(std::size_t i = 0; i < size; ++i){
+                const float value = Masked ? logits[i] + mask[i] : logits[i];
+                scan.masked.add(value);
+                if constexpr(Raw){
+                    scan.raw.add(logits[i]);
+                }
+                scan.top.insert(value, first_id + static_cast<int64_t>(i));
+            }
+        }
+
+#ifdef AIVOICE_X86_KERNELS
+        // exp as in Cephes expf: x = n ln2 + r with |r| <= ln2 / 2, a degree 5
+        // polynomial for exp(r), and n added to the exponent bits. inputs are
+        // clamped to the range where 2^n stays a normal float, so -inf gives ~1e-38
+        __attribute__((target("avx2,fma")))
+        inline __m256 exp_avx2(__m256 x){
+            x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+            const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+            r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+            __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+            p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+            p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+            p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+            p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+            p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+            p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+            const __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+            return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+        }
+
+        // per-lane online softmax: sum = sum * exp(max - new_max) + exp(value - new_max)
+        __attribute__((target("avx2,fma")))
+        inline void softmax_avx2(__m256 value, __m256 & max, __m256 & sum){
+            const __m256 new_max = _mm256_max_ps(max, value);
+            sum = _mm256_fmadd_ps(sum, exp_avx2(_mm256_sub_ps(max, new_max)), exp_avx2(_mm256_sub_ps(value, new_max)));
+            max = new_max;
+        }
+
+        __attribute__((target("avx2,fma")))
+        inline void merge_lanes_avx2(__m256 max, __m256 sum, Softmax & softmax){
+            alignas(32) float maxes[8];
+            alignas(32) float sums[8];
+            _mm256_store_ps(maxes, max);
+            _mm256_store_ps(sums, sum);
+            for(int lane = 0; lane < 8; ++lane){
+                softmax.merge(maxes[lane], sums[lane]);
+            }
+        }
+
+        template<bool Masked, bool Raw>
+        __attribute__((target("avx2,fma")))
+        void scan_avx2(const float * logits, const float * mask, std::size_t size, int64_t first_id, Scan & scan){
+            __m256 masked_max = _mm256_set1_ps(lowest);
+            __m256 masked_sum = _mm256_setzero_ps();
+            __m256 raw_max = _mm256_set1_ps(lowest);
+            __m256 raw_sum = _mm256_setzero_ps();
+            __m256 threshold = _mm256_set1_ps(scan.top.threshold());
+
+            std::size_t i = 0;
+            for(; i + 8 <= size; i += 8){
+                const __m256 raw = _mm256_loadu_ps(logits + i);
+                const __m256 value = Masked ? _mm256_add_ps(raw, _mm256_loadu_ps(mask + i)) : raw;
+                softmax_avx2(value, masked_max, masked_sum);
+                if constexpr(Raw){
+                    softmax_avx2(raw, raw_max, raw_sum);
+                }
+
+                // most blocks hold no top-k candidate once the first few are in
+                int candidates = _mm256_movemask_ps(_mm256_cmp_ps(value, threshold, _CMP_GT_OQ));
+                while(candidates){
+                    const int lane = __builtin_ctz(candidates);
+                    candidates &= candidates - 1;
+                    const std::size_t j = i + lane;
+                    scan.top.insert(Masked ? logits[j] + mask[j] : logits[j], first_id + static_cast<int64_t>(j));
+                    threshold = _mm256_set1_ps(scan.top.threshold());
+                }
+            }
+
+            merge_lanes_avx2(masked_max, masked_sum, scan.masked);
+            if constexpr(Raw){
+                merge_lanes_avx2(raw_max, raw_sum, scan.raw);
+            }
+            scan_scalar<Masked, Raw>(logits + i, Masked ? mask + i : nullptr, size - i, first_id + static_cast<int64_t>(i), scan);
+        }
+
+        // as exp_avx2, with scalef putting n into the exponent
+        __attribute__((target("avx512f")))
+        inline __m512 exp_avx512(__m512 x){
+            x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-87.3f)), _mm512_set1_ps(88.3f));
+            const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504088896341f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+            __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+            r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+
+            __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+            p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+            p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+            p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+            p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+            p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+            p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+            return _mm512_scalef_ps(p, n);
+        }
+
+        __attribute__((target("avx512f")))
+        inline void softmax_avx512(__m512 value, __m512 & max, __m512 & sum){
+            const __m512 new_max = _mm512_max_ps(max, value);
+            sum = _mm512_fmadd_ps(sum, exp_avx512(_mm512_sub_ps(max, new_max)), exp_avx512(_mm512_sub_ps(value, new_max)));
+            max = new_max;
+        }
+
+        __attribute__((target("avx512f")))
+        inline void merge_lanes_avx512(__m512 max, __m512 sum, Softmax & softmax){
+            alignas(64) float maxes[16];
+            alignas(64) float sums[16];
+            _mm512_store_ps(maxes, max);
+            _mm512_store_ps(sums, sum);
+            for(int lane = 0; lane < 16; ++lane){
+                softmax.merge(maxes[lane], sums[lane]);
+            }
+        }
+
+        template<bool Masked, bool Raw>
+        __attribute__((target("avx512f")))
+        void scan_avx512(const float * logits, const float * mask, std::size_t size, int64_t first_id, Scan & scan){
+            __m512 masked_max = _mm512_set1_ps(lowest);
+            __m512 masked_sum = _mm512_setzero_ps();
+            __m512 raw_max = _mm512_set1_ps(lowest);
+            __m512 raw_sum = _mm512_setzero_ps();
+            __m512 threshold = _mm512_set1_ps(scan.top.threshold());
+
+            std::size_t i = 0;
+            for(; i + 16 <= size; i += 16){
+                const __m512 raw = _mm512_loadu_ps(logits + i);
+                const __m512 value = Masked ? _mm512_add_ps(raw, _mm512_loadu_ps(mask + i)) : raw;
+                softmax_avx512(value, masked_max, masked_sum);
+                if constexpr(Raw){
+                    softmax_avx512(raw, raw_max, raw_sum);
+                }
+
+                unsigned candidates = _mm512_cmp_ps_mask(value, threshold, _CMP_GT_OQ);
+                while(candidates){
+                    const int lane = __builtin_ctz(candidates);
+                    candidates &= candidates - 1;
+                    const std::size_t j = i + lane;
+                    scan.top.insert(Masked ? logits[j] + mask[j] : logits[j], first_id + static_cast<int64_t>(j));
+                    threshold = _mm512_set1_ps(scan.top.threshold());
+                }
+            }
+
+            merge_lanes_avx512(masked_max, masked_sum, scan.masked);
+            if constexpr(Raw){
+                merge_lanes_avx512(raw_max, raw_sum, scan.raw);
+            }
+            scan_scalar<Masked, Raw>(logits + i, Masked ? mask + i : nullptr, size - i, first_id + static_cast<int64_t>(i), scan);
+        }
+#endif
+
+        template<bool Masked, bool Raw>
+        void scan_with(LogitsProcessor::Kernel kernel, const float * logits, const float * mask, std::size_t size, int64_t first_id, Scan & scan){
+            switch(kernel){
+#ifdef AIVOICE_X86_KERNELS
+                case LogitsProcessor::Kernel::avx512: scan_avx512<Masked, Raw>(logits, mask, size, first_id, scan); return;
+                case LogitsProcessor::Kernel::avx2: scan_avx2<Masked, Raw>(logits, mask, size, first_id, scan); return;
+#endif
+                default: scan_scalar<Masked, Raw>(logits, mask, size, first_id, scan); return;
+            }
+        }
+
+        template<bool Raw>
+        void scan_row(LogitsProcessor::Kernel kernel, const float * logits, const float * mask, std::size_t masked, std::size_t size, Scan & scan){
+            if(masked > 0){
+                scan_with<true, Raw>(kernel, logits, mask, masked, 0, scan);
+            }
+            if(size > masked){
+                scan_with<false, Raw>(kernel, logits + masked, nullptr, size - masked, static_cast<int64_t>(masked), scan);
+            }
+        }
+
+        void build_mask(std::vector<float> & mask, const std::vector<int64_t> & suppressed){
+            for(int64_t id : suppressed){
+                if(id >= 0 && id < static_cast<int64_t>(mask.size())){
+                    mask[id] = negative_infinity;
+                }
+            }
+        }
+    }
+
+    LogitsProcessor::LogitsProcessor()
+    : lp_kernel(best_kernel()), lp_vocab_size(0), lp_no_speech_token(-1)
+    {
+    }
+
+    LogitsProcessor::LogitsProcessor(int64_t vocab_size, const std::vector<int64_t> & suppressed, const std::vector<int64_t> & suppressed_at_begin, int64_t no_speech_token)
+    : lp_kernel(best_kernel()), lp_vocab_size(std::max<int64_t>(vocab_size, 0)), lp_no_speech_token(no_speech_token)
+    {
+        lp_mask.assign(lp_vocab_size, 0.0f);
+        build_mask(lp_mask, suppressed);
+        lp_begin_mask = lp_mask;
+        build_mask(lp_begin_mask, suppressed_at_begin);
+    }
+
+    LogitsProcessor::Kernel LogitsProcessor::best_kernel(){
+        if(supported(Kernel::avx512)){
+            return Kernel::avx512;
+        }
+        if(supported(Kernel::avx2)){
+            return Kernel::avx2;
+        }
+        return Kernel::scalar;
+    }
+
+    bool LogitsProcessor::supported(Kernel kernel){
+        switch(kernel){
+            case Kernel::scalar: return true;
+#ifdef AIVOICE_X86_KERNELS
+            case Kernel::avx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+            case Kernel::avx512: return __builtin_cpu_supports("avx512f");
+#endif
+            default: return false;
+        }
+    }
+
+    const char * LogitsProcessor::name(Kernel kernel){
+        switch(kernel){
+            case Kernel::scalar: return "scalar";
+            case Kernel::avx2: return "avx2";
+            case Kernel::avx512: return "avx512";
+        }
+        return "unknown";
+    }
+
+    LogitsProcessor::Kernel LogitsProcessor::kernel() const{
+        return lp_kernel;
+    }
+
+    void LogitsProcessor::set_kernel(Kernel kernel){
+        if(!supported(kernel)){
+            throw std::invalid_argument(std::string("logits kernel not supported on this CPU: ") + name(kernel));
+        }
+        lp_kernel = kernel;
+    }
+
+    TokenChoice LogitsProcessor::choose(const float * logits, int64_t vocab_size, bool first_token, const SamplingOptions & sampling, float uniform, float * no_speech_prob) const{
+        const bool sample = sampling.temperature > 0.0f;
+        Scan scan(sample ? std::clamp(sampling.top_k, 1, max_top_k) : 1);
+
+        const std::size_t size = static_cast<std::size_t>(std::max<int64_t>(vocab_size, 0));
+        const std::size_t masked = std::min(size, static_cast<std::size_t>(lp_vocab_size));
+        const float * mask = first_token ? lp_begin_mask.data() : lp_mask.data();
+        const bool no_speech = no_speech_prob && lp_no_speech_token >= 0 && lp_no_speech_token < vocab_size;
+        if(no_speech){
+            scan_row<true>(lp_kernel, logits, mask, masked, size, scan);
+            *no_speech_prob = std::exp(logits[lp_no_speech_token] - scan.raw.log_sum());
+        }else{
+            scan_row<false>(lp_kernel, logits, mask, masked, size, scan);
+            if(no_speech_prob){
+                *no_speech_prob = 0.0f;
+            }
+        }
+
+        // every token suppressed, nothing sensible to pick
+        if(scan.top.count == 0){
+            return TokenChoice{0, negative_infinity};
+        }
+
+        int chosen = 0;
+        if(sample && scan.top.count > 1){
+            float weights[max_top_k];
+            float total = 0.0f;
+            for(int i = 0; i < scan.top.count; ++i){
+                weights[i] = std::exp((scan.top.values[i] - scan.top.values[0]) / sampling.temperature);
+                total += weights[i];
+            }
+            float target = uniform * total;
+            while(chosen + 1 < scan.top.count && target >= weights[chosen]){
+                target -= weights[chosen];
+                ++chosen;
+            }
+        }
+
+        // the log-probability is taken at temperature 1, as Whisper scores its fallbacks
+        return TokenChoice{scan.top.ids[chosen], scan.top.values[chosen] - scan.masked.log_sum()};
+    }
+
+    float LogitsProcessor::no_speech_prob(const float * logits, int64_t vocab_size) const{
+        if(lp_no_speech_token < 0 || lp_no_speech_token >= vocab_size){
+            return 0.0f;
+        }
+        const std::size_t size = static_cast<std::size_t>(vocab_size);
+        const std::size_t masked = std::min(size, static_cast<std::size_t>(lp_vocab_size));
+        Scan scan(1);
+        scan_row<true>(lp_kernel, logits, lp_mask.data(), masked, size, scan);
+        return std::exp(logits[lp_no_speech_token] - scan.raw.log_sum());
+    }
+}
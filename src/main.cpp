@@ -1,11 +1,21 @@
 //file:: main.cpp
 #include "include/server.hpp"
+#include "include/bench.hpp"
 
 #include <stdexcept>
 
-int main(){
+int main(int argc, char ** argv){
     try{
-        auto sp_server = std::make_shared<AIvoice::Server>("localhost",8080,1);
+        AIvoice::ServerConfig config = AIvoice::parse_config(argc, argv);
+        if(config.show_help){
+            std::cout << AIvoice::usage(argv[0]);
+            return EXIT_SUCCESS;
+        }
+        if(!config.bench.empty()){
+            return AIvoice::run_benchmark(config.bench, config);
+        }
+
+        auto sp_server = std::make_shared<AIvoice::Server>(config);
         sp_server->run();
     }catch(const std::exception & e){
         std::cerr << "[[Error]]:: " << e.what() << std::endl;
@@ -13,4 +23,4 @@ int main(){
     }
 
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,167 @@
+//file:: mel_frontend.cpp
+#include "include/mel_frontend.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        // eight independent partial sums so the loop vectorizes without -ffast-math
+        inline float dot(const float * a, const float * b, int n){
+            float partial[8] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+            int i = 0;
+            for(; i + 8 <= n; i += 8){
+                for(int lane = 0; lane < 8; ++lane){
+                    partial[lane] += a[i + lane] * b[i + lane];
+                }
+            }
+            float sum = ((partial[0] + partial[4]) + (partial[1] + partial[5]))
+                      + ((partial[2] + partial[6]) + (partial[3] + partial[7]));
+            for(; i < n; ++i){
+                sum += a[i] * b[i];
+            }
+            return sum;
+        }
+    }
+
+    MelFrontend::MelFrontend(int sample_rate, int n_fft, int hop_length, int n_mel)
+    : m_n_fft(n_fft), m_hop_length(hop_length), m_n_mel(n_mel),
+    m_fft(n_fft), m_window(n_fft)
+    {
+        for(int i = 0; i < n_fft; ++i){
+            m_window[i] = 0.5f * (1.0f - std::cos(2.0f * M_PI * i / (n_fft - 1)));
+        }
+        build_filters(sample_rate);
+    }
+
+    // same triangles as the dense [n_mel, n_fft/2+1] bank, keeping only the nonzero span
+    void MelFrontend::build_filters(int sample_rate){
+        const int bins = m_n_fft / 2 + 1;
+
+        auto hz_to_mel = [](float hz){return 2595.0f * std::log10(1.0f + hz / 700.0f);};
+        auto mel_to_hz = [](float mel){return 700.0f * (std::pow(10.0f, mel / 2595.0f) - 1.0f);};
+
+        float mel_min = hz_to_mel(0.0f);
+        float mel_max = hz_to_mel(sample_rate / 2.0f);
+
+        std::vector<int> bin_points(m_n_mel + 2);
+        for(int i = 0; i < m_n_mel + 2; ++i){
+            float mel_point = mel_min + (mel_max - mel_min) / (m_n_mel + 1) * i;
+            float hz_point = mel_to_hz(mel_point);
+            bin_points[i] = static_cast<int>(std::floor(bins * hz_point / (sample_rate / 2.0f)));
+        }
+
+        m_filter_start.resize(m_n_mel);
+        m_filter_length.resize(m_n_mel);
+        m_filter_offset.resize(m_n_mel);
+        m_filter_weights.clear();
+
+        for(int i = 0; i < m_n_mel; ++i){
+            int left = bin_points[i];
+            int center = bin_points[i + 1];
+            int right = bin_points[i + 2];
+            // the last edge can land one past the top bin
+            int last = std::min(right, bins);
+
+            m_filter_start[i] = std::min(left, bins);
+            m_filter_offset[i] = m_filter_weights.size();
+
+            for(int j = left; j < std::min(center, last); ++j){
+                m_filter_weights.push_back(static_cast<float>(j - left) / static_cast<float>(center - left));
+            }
+            for(int j = center; j < last; ++j){
+                m_filter_weights.push_back(static_cast<float>(right - j) / static_cast<float>(right - center));
+            }
+
+            m_filter_length[i] = static_cast<int>(m_filter_weights.size() - m_filter_offset[i]);
+        }
+    }
+
+    int MelFrontend::n_mel() const{
+        return m_n_mel;
+    }
+
+    int MelFrontend::n_fft() const{
+        return m_n_fft;
+    }
+
+    int MelFrontend::hop_length() const{
+        return m_hop_length;
+    }
+
+    int MelFrontend::time_steps(std::size_t sample_count) const{
+        if(sample_count < static_cast<std::size_t>(m_n_fft)){
+            return 0;
+        }
+        return static_cast<int>((sample_count - m_n_fft) / m_hop_length + 1);
+    }
+
+    MelFrontend::Workspace MelFrontend::make_workspace() const{
+        Workspace workspace;
+        workspace.fft = m_fft.make_workspace();
+        workspace.frame.resize(m_n_fft);
+        workspace.magnitude.resize(m_fft.bins());
+        workspace.time_major.resize(static_cast<std::size_t>(block_frames) * m_n_mel);
+        return workspace;
+    }
+
+    void MelFrontend::compute(const float * samples, std::size_t sample_count, float * output, Workspace & workspace) const{
+        int steps = time_steps(sample_count);
+        compute_frames(samples, steps, 0, steps, output, workspace);
+    }
+
+    void MelFrontend::compute_parallel(const float * samples, std::size_t sample_count, float * output, std::vector<Workspace> & workspaces, WorkerPool & pool) const{
+        const int steps = time_steps(sample_count);
+        // ranges are whole blocks, so every worker transposes full blocks into disjoint columns
+        const std::size_t blocks = static_cast<std::size_t>((steps + block_frames - 1) / block_frames);
+        const std::size_t workers = std::min(workspaces.size(), std::max<std::size_t>(1, blocks / min_blocks_per_worker));
+
+        parallel_for(pool, blocks, workers, [&](std::size_t worker, std::size_t begin, std::size_t end){
+            int frame_begin = static_cast<int>(begin) * block_frames;
+            int frame_end = std::min(static_cast<int>(end) * block_frames, steps);
+            compute_frames(samples, steps, frame_begin, frame_end, output, workspaces[worker]);
+        });
+    }
+
+    void MelFrontend::compute_frames(const float * samples, int time_steps, int frame_begin, int frame_end, float * output, Workspace & workspace) const{
+        if(workspace.frame.size() != static_cast<std::size_t>(m_n_fft)){
+            workspace = make_workspace();
+        }
+
+        for(int block_begin = frame_begin; block_begin < frame_end; block_begin += block_frames){
+            int block_end = std::min(block_begin + block_frames, frame_end);
+
+            for(int t = block_begin; t < block_end; ++t){
+                const float * frame_samples = samples + static_cast<std::size_t>(t) * m_hop_length;
+                for(int j = 0; j < m_n_fft; ++j){
+                    workspace.frame[j] = frame_samples[j] * m_window[j];
+                }
+
+                m_fft.magnitude(workspace.frame.data(), workspace.magnitude.data(), workspace.fft);
+
+                float * row = workspace.time_major.data() + static_cast<std::size_t>(t - block_begin) * m_n_mel;
+                for(int m = 0; m < m_n_mel; ++m){
+                    float mel_sum = dot(
+                        m_filter_weights.data() + m_filter_offset[m],
+                        workspace.magnitude.data() + m_filter_start[m],
+                        m_filter_length[m]
+                    );
+                    row[m] = std::log(mel_sum + 1e-6f);
+                }
+            }
+
+            // one contiguous run of block frames per mel row instead of a strided store per value
+            int block_size = block_end - block_begin;
+            for(int m = 0; m < m_n_mel; ++m){
+                float * out_row = output + static_cast<std::size_t>(m) * time_steps + block_begin;
+                const float * in_column = workspace.time_major.data() + m;
+                for(int t = 0; t < block_size; ++t){
+                    out_row[t] = in_column[static_cast<std::size_t>(t) * m_n_mel];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,42 @@
+//file:: metrics.cpp
+#include "include/metrics.hpp"
+
+#include <algorithm>
+
+
+namespace AIvoice{
+
+    Histogram::Histogram(std::vector<double> bounds)
+    : m_bounds(std::move(bounds)), m_counts(new std::atomic<uint64_t>[m_bounds.size() + 1]),
+    m_count(0), m_sum(0.0)
+    {
+        std::sort(m_bounds.begin(), m_bounds.end());
+        for(size_t i = 0; i < m_bounds.size() + 1; ++i){
+            m_counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void Histogram::record(double value){
+        size_t bucket = std::lower_bound(m_bounds.begin(), m_bounds.end(), value) - m_bounds.begin();
+        m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_count.fetch_add(1, std::memory_order_relaxed);
+
+        double sum = m_sum.load(std::memory_order_relaxed);
+        while(!m_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)){
+        }
+    }
+
+    nlohmann::json Histogram::to_json() const{
+        nlohmann::json res_json;
+        res_json["bounds"] = m_bounds;
+
+        std::vector<uint64_t> counts(m_bounds.size() + 1);
+        for(size_t i = 0; i < counts.size(); ++i){
+            counts[i] = m_counts[i].load(std::memory_order_relaxed);
+        }
+        res_json["counts"] = counts;
+        res_json["count"] = m_count.load(std::memory_order_relaxed);
+        res_json["sum"] = m_sum.load(std::memory_order_relaxed);
+        return res_json;
+    }
+}
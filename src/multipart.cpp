@@ -0,0 +1,129 @@
+//file:: multipart.cpp
+#include "include/multipart.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        bool iequals(std::string_view a, std::string_view b){
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y){
+                return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+            });
+        }
+
+        std::string_view trim(std::string_view text){
+            while(!text.empty() && (text.front() == ' ' || text.front() == '\t')){
+                text.remove_prefix(1);
+            }
+            while(!text.empty() && (text.back() == ' ' || text.back() == '\t')){
+                text.remove_suffix(1);
+            }
+            return text;
+        }
+
+        std::string unquote(std::string_view value){
+            value = trim(value);
+            if(value.size() >= 2 && value.front() == '"' && value.back() == '"'){
+                value = value.substr(1, value.size() - 2);
+            }
+            return std::string(value);
+        }
+
+        // value of `key` in a header like `form-data; name="a"; filename="b.jpg"`
+        std::string header_parameter(std::string_view header, std::string_view key){
+            size_t pos = 0;
+            while(pos < header.size()){
+                size_t end = header.find(';', pos);
+                if(end == std::string_view::npos){
+                    end = header.size();
+                }
+                std::string_view item = trim(header.substr(pos, end - pos));
+                size_t eq = item.find('=');
+                if(eq != std::string_view::npos && iequals(trim(item.substr(0, eq)), key)){
+                    return unquote(item.substr(eq + 1));
+                }
+                pos = end + 1;
+            }
+            return "";
+        }
+    }
+
+    std::string multipart_boundary(std::string_view content_type){
+        std::string_view media_type = trim(content_type.substr(0, content_type.find(';')));
+        if(!iequals(media_type, "multipart/form-data")){
+            return "";
+        }
+        return header_parameter(content_type, "boundary");
+    }
+
+    std::vector<MultipartPart> parse_multipart(std::string_view body, const std::string & boundary){
+        if(boundary.empty()){
+            throw std::invalid_argument("multipart body without a boundary");
+        }
+
+        const std::string delimiter = "--" + boundary;
+        // every delimiter after the first one is preceded by a line break
+        const std::string separator = "\r\n" + delimiter;
+
+        size_t pos = body.find(delimiter);
+        if(pos == std::string_view::npos){
+            throw std::invalid_argument("multipart boundary not found in body");
+        }
+        pos += delimiter.size();
+
+        std::vector<MultipartPart> parts;
+        while(true){
+            if(body.substr(pos, 2) == "--"){
+                return parts;
+            }
+            if(body.substr(pos, 2) != "\r\n"){
+                throw std::invalid_argument("malformed multipart delimiter");
+            }
+            pos += 2;
+
+            // searching from the delimiter's own line break also finds an empty header block
+            size_t headers_end = body.find("\r\n\r\n", pos - 2);
+            if(headers_end == std::string_view::npos){
+                throw std::invalid_argument("multipart part without a header terminator");
+            }
+
+            MultipartPart part;
+            std::string_view headers = headers_end > pos ? body.substr(pos, headers_end - pos) : std::string_view();
+            size_t line_start = 0;
+            while(line_start <= headers.size()){
+                size_t line_end = headers.find("\r\n", line_start);
+                if(line_end == std::string_view::npos){
+                    line_end = headers.size();
+                }
+                std::string_view line = headers.substr(line_start, line_end - line_start);
+                size_t colon = line.find(':');
+                if(colon != std::string_view::npos){
+                    std::string_view field = trim(line.substr(0, colon));
+                    std::string_view value = trim(line.substr(colon + 1));
+                    if(iequals(field, "Content-Disposition")){
+                        part.name = header_parameter(value, "name");
+                        part.filename = header_parameter(value, "filename");
+                    }else if(iequals(field, "Content-Type")){
+                        part.content_type = std::string(value);
+                    }
+                }
+                line_start = line_end + 2;
+            }
+
+            size_t data_start = headers_end + 4;
+            size_t data_end = body.find(separator, data_start);
+            if(data_end == std::string_view::npos){
+                throw std::invalid_argument("multipart part is not terminated by the boundary");
+            }
+            part.data = body.substr(data_start, data_end - data_start);
+            parts.push_back(std::move(part));
+
+            pos = data_end + separator.size();
+        }
+    }
+}
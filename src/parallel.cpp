@@ -0,0 +1,54 @@
+//file:: parallel.cpp
+#include "include/parallel.hpp"
+
+
+namespace AIvoice{
+
+    WorkerPool::WorkerPool(std::size_t threads)
+    : p_stopping(false)
+    {
+        p_threads.reserve(threads);
+        for(std::size_t i = 0; i < threads; ++i){
+            p_threads.emplace_back([this](){ loop(); });
+        }
+    }
+
+    WorkerPool::~WorkerPool(){
+        {
+            std::lock_guard<std::mutex> lock(p_mutex);
+            p_stopping = true;
+        }
+        p_cv.notify_all();
+        for(auto & thread : p_threads){
+            thread.join();
+        }
+    }
+
+    std::size_t WorkerPool::threads() const{
+        return p_threads.size();
+    }
+
+    void WorkerPool::post(std::function<void()> task){
+        {
+            std::lock_guard<std::mutex> lock(p_mutex);
+            p_tasks.push_back(std::move(task));
+        }
+        p_cv.notify_one();
+    }
+
+    void WorkerPool::loop(){
+        std::unique_lock<std::mutex> lock(p_mutex);
+        while(true){
+            p_cv.wait(lock, [this](){ return p_stopping || !p_tasks.empty(); });
+            if(p_tasks.empty()){
+                return;
+            }
+            std::function<void()> task = std::move(p_tasks.front());
+            p_tasks.pop_front();
+
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+}
@@ -0,0 +1,257 @@
+//file:: pcm_input.cpp
+#include "include/pcm_input.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        const uint16_t wave_format_pcm = 0x0001;
+        const uint16_t wave_format_ieee_float = 0x0003;
+        const uint16_t wave_format_extensible = 0xFFFE;
+
+        uint16_t read_u16(const unsigned char * p){
+            return static_cast<uint16_t>(p[0] | (p[1] << 8));
+        }
+
+        uint32_t read_u32(const unsigned char * p){
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8)
+                 | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        constexpr std::size_t bytes_per_sample(SampleEncoding encoding){
+            switch(encoding){
+                case SampleEncoding::u8: return 1;
+                case SampleEncoding::s16le:
+                case SampleEncoding::s16be: return 2;
+                case SampleEncoding::s24le: return 3;
+                case SampleEncoding::s32le:
+                case SampleEncoding::f32le: return 4;
+            }
+            return 0;
+        }
+
+        // one sample to [-1, 1). written as byte arithmetic so the loops below
+        // stay endian-independent and the compiler can still vectorize them
+        template<SampleEncoding Encoding>
+        float read_sample(const unsigned char * p){
+            if constexpr(Encoding == SampleEncoding::u8){
+                return (static_cast<float>(p[0]) - 128.0f) * (1.0f / 128.0f);
+            }else if constexpr(Encoding == SampleEncoding::s16le){
+                return static_cast<float>(static_cast<int16_t>(p[0] | (p[1] << 8))) * (1.0f / 32768.0f);
+            }else if constexpr(Encoding == SampleEncoding::s16be){
+                return static_cast<float>(static_cast<int16_t>((p[0] << 8) | p[1])) * (1.0f / 32768.0f);
+            }else if constexpr(Encoding == SampleEncoding::s24le){
+                // the top byte goes in bits 24-31 so the shift back sign-extends
+                int32_t value = static_cast<int32_t>((static_cast<uint32_t>(p[0]) << 8) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 24)) >> 8;
+                return static_cast<float>(value) * (1.0f / 8388608.0f);
+            }else if constexpr(Encoding == SampleEncoding::s32le){
+                return static_cast<float>(static_cast<int32_t>(read_u32(p))) * (1.0f / 2147483648.0f);
+            }else{
+                uint32_t bits = read_u32(p);
+                float value;
+                std::memcpy(&value, &bits, sizeof(value));
+                return value;
+            }
+        }
+
+        template<SampleEncoding Encoding>
+        void convert_frames(const unsigned char * data, std::size_t frames, int channels, float * output){
+            constexpr std::size_t sample_bytes = bytes_per_sample(Encoding);
+
+            if(channels == 1){
+                for(std::size_t i = 0; i < frames; ++i){
+                    output[i] = read_sample<Encoding>(data + i * sample_bytes);
+                }
+                return;
+            }
+
+            const std::size_t frame_bytes = sample_bytes * channels;
+            const float scale = 1.0f / channels;
+            for(std::size_t i = 0; i < frames; ++i){
+                const unsigned char * frame = data + i * frame_bytes;
+                float sum = 0.0f;
+                for(int c = 0; c < channels; ++c){
+                    sum += read_sample<Encoding>(frame + c * sample_bytes);
+                }
+                output[i] = sum * scale;
+            }
+        }
+
+        std::string_view trim(std::string_view text){
+            while(!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))){
+                text.remove_prefix(1);
+            }
+            while(!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))){
+                text.remove_suffix(1);
+            }
+            return text;
+        }
+
+        std::string lowercase(std::string_view text){
+            std::string result(text);
+            std::transform(result.begin(), result.end(), result.begin(), [](unsigned char c){ return static_cast<char>(std::tolower(c)); });
+            return result;
+        }
+
+        // a positive integer parameter, nothing when it is not one
+        std::optional<int> parse_positive(std::string_view value){
+            int result = 0;
+            if(value.empty() || value.size() > 9){
+                return std::nullopt;
+            }
+            for(char c : value){
+                if(c < '0' || c > '9'){
+                    return std::nullopt;
+                }
+                result = result * 10 + (c - '0');
+            }
+            if(result <= 0){
+                return std::nullopt;
+            }
+            return result;
+        }
+    }
+
+    std::size_t PcmFormat::frame_bytes() const{
+        return bytes_per_sample(encoding) * static_cast<std::size_t>(channels);
+    }
+
+    std::size_t PcmAudio::frames() const{
+        return payload.size() / format.frame_bytes();
+    }
+
+    std::optional<PcmAudio> parse_wav(std::span<const unsigned char> bytes){
+        if(bytes.size() < 12 || std::memcmp(bytes.data(), "RIFF", 4) != 0 || std::memcmp(bytes.data() + 8, "WAVE", 4) != 0){
+            return std::nullopt;
+        }
+
+        std::optional<PcmFormat> format;
+        std::size_t pos = 12;
+        while(pos + 8 <= bytes.size()){
+            const unsigned char * chunk = bytes.data() + pos;
+            const std::size_t chunk_size = read_u32(chunk + 4);
+            const std::size_t body = pos + 8;
+            const std::size_t available = bytes.size() - body;
+
+            if(std::memcmp(chunk, "fmt ", 4) == 0){
+                if(chunk_size < 16 || available < 16){
+                    return std::nullopt;
+                }
+                const unsigned char * fmt = chunk + 8;
+                uint16_t tag = read_u16(fmt);
+                const int channels = read_u16(fmt + 2);
+                const int sample_rate = static_cast<int>(read_u32(fmt + 4));
+                const int bits = read_u16(fmt + 14);
+                // the real tag sits in the first two bytes of the subformat GUID
+                if(tag == wave_format_extensible){
+                    if(chunk_size < 40 || available < 40){
+                        return std::nullopt;
+                    }
+                    tag = read_u16(fmt + 24);
+                }
+                if(channels <= 0 || sample_rate <= 0){
+                    return std::nullopt;
+                }
+
+                if(tag == wave_format_pcm && bits == 8){
+                    format = PcmFormat{SampleEncoding::u8, sample_rate, channels};
+                }else if(tag == wave_format_pcm && bits == 16){
+                    format = PcmFormat{SampleEncoding::s16le, sample_rate, channels};
+                }else if(tag == wave_format_pcm && bits == 24){
+                    format = PcmFormat{SampleEncoding::s24le, sample_rate, channels};
+                }else if(tag == wave_format_pcm && bits == 32){
+                    format = PcmFormat{SampleEncoding::s32le, sample_rate, channels};
+                }else if(tag == wave_format_ieee_float && bits == 32){
+                    format = PcmFormat{SampleEncoding::f32le, sample_rate, channels};
+                }else{
+                    return std::nullopt;
+                }
+            }else if(std::memcmp(chunk, "data", 4) == 0){
+                if(!format){
+                    return std::nullopt;
+                }
+                // streaming writers leave the size at 0 or 0xFFFFFFFF, take what is there
+                std::size_t size = (chunk_size == 0 || chunk_size > available) ? available : chunk_size;
+                size -= size % format->frame_bytes();
+                return PcmAudio{*format, bytes.subspan(body, size)};
+            }
+
+            // chunks are padded to an even size
+            pos = body + chunk_size + (chunk_size & 1);
+        }
+        return std::nullopt;
+    }
+
+    std::optional<PcmFormat> parse_pcm_content_type(std::string_view content_type){
+        std::size_t separator = content_type.find(';');
+        const std::string type = lowercase(trim(content_type.substr(0, separator)));
+
+        PcmFormat format{SampleEncoding::s16le, 16000, 1};
+        if(type == "audio/l16"){
+            format.encoding = SampleEncoding::s16be;
+        }else if(type != "audio/pcm" && type != "audio/x-pcm" && type != "audio/raw"){
+            return std::nullopt;
+        }
+
+        while(separator != std::string_view::npos){
+            content_type.remove_prefix(separator + 1);
+            separator = content_type.find(';');
+            std::string_view parameter = content_type.substr(0, separator);
+            std::size_t equals = parameter.find('=');
+            if(equals == std::string_view::npos){
+                continue;
+            }
+            const std::string name = lowercase(trim(parameter.substr(0, equals)));
+            const std::string value = lowercase(trim(parameter.substr(equals + 1)));
+
+            if(name == "rate"){
+                std::optional<int> rate = parse_positive(value);
+                if(!rate){
+                    return std::nullopt;
+                }
+                format.sample_rate = *rate;
+            }else if(name == "channels"){
+                std::optional<int> channels = parse_positive(value);
+                if(!channels){
+                    return std::nullopt;
+                }
+                format.channels = *channels;
+            }else if(name == "format" || name == "encoding"){
+                if(value == "u8"){
+                    format.encoding = SampleEncoding::u8;
+                }else if(value == "s16le"){
+                    format.encoding = SampleEncoding::s16le;
+                }else if(value == "s16be"){
+                    format.encoding = SampleEncoding::s16be;
+                }else if(value == "s24le"){
+                    format.encoding = SampleEncoding::s24le;
+                }else if(value == "s32le"){
+                    format.encoding = SampleEncoding::s32le;
+                }else if(value == "f32le"){
+                    format.encoding = SampleEncoding::f32le;
+                }else{
+                    return std::nullopt;
+                }
+            }
+        }
+        return format;
+    }
+
+    void pcm_to_mono_float(const PcmFormat & format, const unsigned char * data, std::size_t frames, float * output){
+        switch(format.encoding){
+            case SampleEncoding::u8: convert_frames<SampleEncoding::u8>(data, frames, format.channels, output); break;
+            case SampleEncoding::s16le: convert_frames<SampleEncoding::s16le>(data, frames, format.channels, output); break;
+            case SampleEncoding::s16be: convert_frames<SampleEncoding::s16be>(data, frames, format.channels, output); break;
+            case SampleEncoding::s24le: convert_frames<SampleEncoding::s24le>(data, frames, format.channels, output); break;
+            case SampleEncoding::s32le: convert_frames<SampleEncoding::s32le>(data, frames, format.channels, output); break;
+            case SampleEncoding::f32le: convert_frames<SampleEncoding::f32le>(data, frames, format.channels, output); break;
+        }
+    }
+}
@@ -0,0 +1,104 @@
+//file:: resampler.cpp
+#include "include/resampler.hpp"
+
+extern "C" {
+    #include <libavutil/avutil.h>
+    #include <libavutil/channel_layout.h>
+    #include <libavutil/frame.h>
+    #include <libswresample/swresample.h>
+}
+
+
+namespace AIvoice{
+
+    AudioResampler::AudioResampler(int output_rate)
+    : rs_output_rate(output_rate), rs_context(nullptr),
+    rs_input_format(AV_SAMPLE_FMT_NONE), rs_input_rate(0), rs_input_channels(0)
+    {
+    }
+
+    AudioResampler::~AudioResampler(){
+        swr_free(&rs_context);
+    }
+
+    bool AudioResampler::convert(const AVFrame * frame, std::vector<float> & output){
+        output.clear();
+        if(!configure(frame->format, frame->sample_rate, &frame->ch_layout, frame->ch_layout.nb_channels, output)){
+            return false;
+        }
+        return drain(const_cast<const unsigned char **>(frame->extended_data), frame->nb_samples, output);
+    }
+
+    bool AudioResampler::convert(const float * samples, int count, int input_rate, std::vector<float> & output){
+        output.clear();
+        if(!configure(AV_SAMPLE_FMT_FLT, input_rate, nullptr, 1, output)){
+            return false;
+        }
+        const unsigned char * planes[1] = {reinterpret_cast<const unsigned char *>(samples)};
+        return drain(planes, count, output);
+    }
+
+    bool AudioResampler::flush(std::vector<float> & output){
+        output.clear();
+        return !rs_context || drain(nullptr, 0, output);
+    }
+
+    bool AudioResampler::configure(int format, int rate, const AVChannelLayout * layout, int channels, std::vector<float> & output){
+        if(rs_context){
+            if(format == rs_input_format && rate == rs_input_rate && channels == rs_input_channels){
+                return true;
+            }
+            // the old input's tail goes out first
+            if(!drain(nullptr, 0, output)){
+                return false;
+            }
+            swr_free(&rs_context);
+        }
+
+        // some demuxers only know the channel count, take the usual layout for it
+        AVChannelLayout input_layout;
+        if(!layout || layout->order == AV_CHANNEL_ORDER_UNSPEC){
+            av_channel_layout_default(&input_layout, channels > 0 ? channels : 1);
+        }else if(av_channel_layout_copy(&input_layout, layout) < 0){
+            return false;
+        }
+        AVChannelLayout output_layout = AV_CHANNEL_LAYOUT_MONO;
+
+        int ret = swr_alloc_set_opts2(
+            &rs_context,
+            &output_layout, AV_SAMPLE_FMT_FLT, rs_output_rate,
+            &input_layout, static_cast<AVSampleFormat>(format), rate,
+            0, nullptr
+        );
+        av_channel_layout_uninit(&input_layout);
+        if(ret < 0 || swr_init(rs_context) < 0){
+            swr_free(&rs_context);
+            return false;
+        }
+
+        rs_input_format = format;
+        rs_input_rate = rate;
+        rs_input_channels = channels;
+        return true;
+    }
+
+    bool AudioResampler::drain(const unsigned char ** input, int input_samples, std::vector<float> & output){
+        // upper bound for this call, buffered delay included
+        int capacity = swr_get_out_samples(rs_context, input_samples);
+        if(capacity < 0){
+            return false;
+        }
+        const std::size_t offset = output.size();
+        output.resize(offset + capacity);
+
+        // packed float mono: one plane, written in place
+        uint8_t * planes[1] = {reinterpret_cast<uint8_t *>(output.data() + offset)};
+        int converted = swr_convert(rs_context, planes, capacity, input, input_samples);
+        if(converted < 0){
+            output.resize(offset);
+            return false;
+        }
+        output.resize(offset + converted);
+        return true;
+    }
+}
@@ -5,10 +5,12 @@
 
 namespace AIvoice{
 
-    Server::Server(std::string ipaddr, unsigned int port, int threads)
-    : s_ipaddr(std::move(ipaddr)), s_port(port),
-    s_ioc(threads), s_acceptor(s_ioc, s_make_endpoint()),
-    s_ai_manager()
+    Server::Server(const ServerConfig & config)
+    : s_config(config), s_ipaddr(config.host), s_port(config.port),
+    s_ioc(config.io_threads), s_acceptor(s_ioc, s_make_endpoint()),
+    s_signals(s_ioc, SIGINT, SIGTERM),
+    s_ai_manager(config.ai), s_upload_writer(1, 64), s_upload_count(0),
+    s_executor(config.compute_threads, config.queue_depth)
     {
     }
 
@@ -28,11 +30,33 @@ namespace AIvoice{
     void Server::run(){
         //load the ai model
         //wait a min, reload when somebody refresh the website every time?
-        s_ai_manager.load_image_model("../models/mobilenetv2-7.onnx");
-        s_ai_manager.load_audio_model("../models/whisper_base/encoder_model.onnx","../models/whisper_base/decoder_model.onnx");
+        s_ai_manager.load_image_model(s_config.image_model_path);
+        s_ai_manager.load_audio_model(s_config.encoder_model_path, s_config.decoder_model_path, s_config.decoder_with_past_model_path);
         do_accept();
-        std::cout << "Server listening on " << s_ipaddr << ":" << s_port << std::endl;
+
+        s_signals.async_wait([this](boost::beast::error_code ec, int){
+            if(!ec){
+                std::cout << "Shutting down." << std::endl;
+                s_ioc.stop();
+            }
+        });
+
+        std::cout << "Server listening on " << s_ipaddr << ":" << s_port
+                  << " (io threads: " << s_config.io_threads
+                  << ", compute threads: " << s_executor.threads() << ")" << std::endl;
+
+        std::vector<std::thread> io_threads;
+        io_threads.reserve(s_config.io_threads - 1);
+        for(int i = 1; i < s_config.io_threads; ++i){
+            io_threads.emplace_back([this](){
+                s_ioc.run();
+            });
+        }
         s_ioc.run();
+
+        for(auto & t : io_threads){
+            t.join();
+        }
     }
 
     void Server::do_accept(){
@@ -40,124 +64,271 @@ namespace AIvoice{
             boost::asio::make_strand(s_ioc),
             [this](boost::beast::error_code ec, boost::asio::ip::tcp::socket socket){
                 if(!ec){
-                    boost::beast::tcp_stream stream(std::move(socket));
-
-                    boost::beast::flat_buffer buffer;
-                    boost::beast::http::request<boost::beast::http::string_body> req;
-                    boost::beast::http::read(stream, buffer, req);
-
-                    handle_request(std::move(req), stream);
+                    std::make_shared<HttpSession>(
+                        std::move(socket),
+                        [this](HttpRequest && req, ResponseSender send){
+                            handle_request(std::move(req), std::move(send));
+                        },
+                        s_config.session
+                    )->start();
+                }else{
+                    std::cerr << "Error accepting connection: " << ec.message() << std::endl;
                 }
                 do_accept();
             }
         );
     }
 
-    void Server::handle_request(
-        boost::beast::http::request<boost::beast::http::string_body> && req,
-        boost::beast::tcp_stream & stream
+    HttpResponse Server::make_json_response(
+        boost::beast::http::status status,
+        const nlohmann::json & res_json,
+        const HttpRequest & req
     ){
-        std::string response_body;
-        boost::beast::http::status response_status;
-
+        HttpResponse res{status, req.version()};
+        res.set(boost::beast::http::field::server, "AIvoice-Server");
+        res.set(boost::beast::http::field::content_type, "application/json");
+        res.keep_alive(req.keep_alive());
+        res.body() = res_json.dump();
+        res.prepare_payload();
+        return res;
+    }
 
+    void Server::handle_request(HttpRequest && req, ResponseSender send){
         if(req.method() == boost::beast::http::verb::get && req.target() == "/"){
-            response_status = boost::beast::http::status::ok;
             nlohmann::json res_json;
             res_json["status"] = "ok";
             res_json["message"] = "Welcome to AIvoice";
-            response_body = res_json.dump();
+            send(make_json_response(boost::beast::http::status::ok, res_json, req));
+        }else if(req.method() == boost::beast::http::verb::get && req.target() == "/health"){
+            // answered on the io thread, never waits behind inference
+            nlohmann::json res_json;
+            res_json["status"] = "ok";
+            res_json["inference_pending"] = s_executor.pending();
+            res_json["inference_capacity"] = s_executor.capacity();
+            send(make_json_response(boost::beast::http::status::ok, res_json, req));
+        }else if(req.method() == boost::beast::http::verb::get && req.target() == "/metrics"){
+            nlohmann::json res_json = s_ai_manager.stats();
+            res_json["status"] = "ok";
+            send(make_json_response(boost::beast::http::status::ok, res_json, req));
         }else if(req.method() == boost::beast::http::verb::post && req.target() == "/upload"){
-            try{
-                // the whole body just contains <upload_files>
-                const std::string & body_content = req.body();
+            submit_inference_async(std::move(req), std::move(send), &Server::handle_upload);
+        }else if(req.method() == boost::beast::http::verb::post && req.target() == "/upload/batch"){
+            submit_inference(std::move(req), std::move(send), &Server::handle_upload_batch);
+        }else if(req.method() == boost::beast::http::verb::post && req.target() == "/transcribe"){
+            submit_inference(std::move(req), std::move(send), &Server::handle_transcribe);
+        }else{
+            nlohmann::json res_json;
+            res_json["status"] = "error";
+            res_json["message"] = "Resource not found";
+            send(make_json_response(boost::beast::http::status::not_found, res_json, req));
+        }
+    }
 
-                auto now = std::chrono::system_clock::now();
-                auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
-                std::string filename = "file_" + std::to_string(now_ms.count()) + ".bin";
-                std::string filepath = "../uploaded_files/" + filename;
+    void Server::submit_inference(
+        HttpRequest && req,
+        ResponseSender send,
+        HttpResponse (Server::*handler)(const std::shared_ptr<const HttpRequest> &)
+    ){
+        std::shared_ptr<const HttpRequest> shared_req = std::make_shared<HttpRequest>(std::move(req));
 
+        bool accepted = s_executor.try_submit(
+            [this, shared_req, send, handler](){
+                send((this->*handler)(shared_req));
+            }
+        );
 
-                // std::cout << filepath << std::endl;
+        if(!accepted){
+            send_busy(*shared_req, send);
+        }
+    }
 
-                std::ofstream outfile(filepath, std::ios::binary);
-                if(!outfile.is_open()){
-                    throw std::runtime_error("Could not open file for writing.\n");
-                }
-                outfile.write(body_content.c_str(), body_content.length());
-                outfile.close();
+    void Server::submit_inference_async(
+        HttpRequest && req,
+        ResponseSender send,
+        void (Server::*handler)(const std::shared_ptr<const HttpRequest> &, ResponseSender)
+    ){
+        std::shared_ptr<const HttpRequest> shared_req = std::make_shared<HttpRequest>(std::move(req));
+
+        bool accepted = s_executor.try_submit_async(
+            [this, shared_req, send, handler](InferenceExecutor::Admission admission){
+                //the slot goes with the last copy of the sender
+                (this->*handler)(shared_req, [send, admission = std::move(admission)](HttpResponse && res){
+                    send(std::move(res));
+                });
+            }
+        );
 
+        if(!accepted){
+            send_busy(*shared_req, send);
+        }
+    }
 
-                //use the ai
-                std::string inference_result = s_ai_manager.run_image_inference(filepath);
+    void Server::send_busy(const HttpRequest & req, const ResponseSender & send){
+        // shed load right away rather than letting work pile up behind the models
+        nlohmann::json res_json;
+        res_json["status"] = "error";
+        res_json["message"] = "Server busy, try again later.";
+        HttpResponse res = make_json_response(boost::beast::http::status::service_unavailable, res_json, req);
+        res.set(boost::beast::http::field::retry_after, "1");
+        send(std::move(res));
+    }
 
-                response_status = boost::beast::http::status::ok;
-                nlohmann::json res_json;
-                res_json["status"] = "ok";
-                res_json["message"] = "File uploaded successfully.";
-                res_json["filename"] = filename;
-                res_json["inference_result"] = inference_result;
-                response_body = res_json.dump();
-                
-
-            }catch(const std::exception & e){
-                std::cerr << "Error during file upload: " << e.what() << std::endl;
-                response_status = boost::beast::http::status::internal_server_error;
-                nlohmann::json res_json;
-                res_json["status"] = "error";
-                res_json["message"] = "Server error during upload.";
-                response_body = res_json.dump();
+    std::string Server::persist_upload(const std::shared_ptr<const HttpRequest> & req, const std::string & prefix, const std::string & extension){
+        if(!s_config.persist_uploads){
+            return "";
+        }
+
+        auto now = std::chrono::system_clock::now();
+        auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
+        const std::uint64_t count = s_upload_count.fetch_add(1, std::memory_order_relaxed);
+        std::string filename = prefix + std::to_string(now_ms.count()) + "_" + std::to_string(count) + extension;
+        std::string filepath = s_config.upload_dir + "/" + filename;
+
+        // the request stays alive until the write is done, the body is not copied
+        bool accepted = s_upload_writer.try_submit([req, filepath](){
+            std::ofstream outfile(filepath, std::ios::binary);
+            if(!outfile.is_open()){
+                std::cerr << "Error: Could not open " << filepath << " for writing." << std::endl;
+                return;
             }
-        }else if(req.method() == boost::beast::http::verb::post && req.target() == "/transcribe"){
-            try
-            {
-                const std::string & body_content = req.body();
-                auto now = std::chrono::system_clock::now();
-                auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch());
-                std::string filename = "audio_" + std::to_string(now_ms.count()) + ".wav";
-                std::string filepath = "../uploaded_files/" + filename;
-
-                std::ofstream outfile(filepath, std::ios::binary);
-                if(!outfile.is_open()){
-                    throw std::runtime_error("Could not open file for writing.\n");
+            outfile.write(req->body().data(), req->body().size());
+        });
+
+        if(!accepted){
+            std::cerr << "Upload writer is behind, not persisting " << filename << std::endl;
+            return "";
+        }
+        return filename;
+    }
+
+    void Server::handle_upload(const std::shared_ptr<const HttpRequest> & req, ResponseSender send){
+        auto upload_failed = [this, req](const std::exception & e){
+            std::cerr << "Error during file upload: " << e.what() << std::endl;
+            nlohmann::json res_json;
+            res_json["status"] = "error";
+            res_json["message"] = "Server error during upload.";
+            return make_json_response(boost::beast::http::status::internal_server_error, res_json, *req);
+        };
+
+        try{
+            // the whole body just contains <upload_files>
+            const std::string & body_content = req->body();
+
+            std::string filename = persist_upload(req, "file_", ".bin");
+
+            //use the ai, straight from the request buffer; the answer is sent once its batch ran
+            s_ai_manager.run_image_inference(
+                std::span<const unsigned char>(reinterpret_cast<const unsigned char *>(body_content.data()), body_content.size()),
+                [this, req, send, filename, upload_failed](std::future<std::string> result){
+                    try{
+                        nlohmann::json res_json;
+                        res_json["status"] = "ok";
+                        res_json["message"] = "File uploaded successfully.";
+                        if(!filename.empty()){
+                            res_json["filename"] = filename;
+                        }
+                        res_json["inference_result"] = result.get();
+                        send(make_json_response(boost::beast::http::status::ok, res_json, *req));
+                    }catch(const std::exception & e){
+                        send(upload_failed(e));
+                    }
                 }
-                outfile.write(body_content.c_str(), body_content.length());
-                outfile.close();
+            );
 
-                std::string transcription_result = s_ai_manager.transcribe_audio(filepath);
+        }catch(const std::exception & e){
+            send(upload_failed(e));
+        }
+    }
 
-                response_status = boost::beast::http::status::ok;
-                nlohmann::json res_json;
-                res_json["status"] = "ok";
-                res_json["message"] = "Audio uploaded and processing started.";
-                res_json["filename"] = filename;
-                res_json["transcription_result"] = transcription_result;
-                response_body = res_json.dump();
+    HttpResponse Server::handle_upload_batch(const std::shared_ptr<const HttpRequest> & req){
+        std::vector<MultipartPart> parts;
+        try{
+            auto content_type = (*req)[boost::beast::http::field::content_type];
+            std::string boundary = multipart_boundary(std::string_view(content_type.data(), content_type.size()));
+            if(boundary.empty()){
+                throw std::invalid_argument("expected a multipart/form-data body");
             }
-            catch(const std::exception& e)
-            {
-                std::cerr << "Error during file transcribed: " << e.what() << std::endl;
-                response_status = boost::beast::http::status::internal_server_error;
-                nlohmann::json res_json;
-                res_json["status"] = "error";
-                res_json["message"] = "Server error during transcribed.";
-                response_body = res_json.dump();
+            parts = parse_multipart(req->body(), boundary);
+            if(parts.empty()){
+                throw std::invalid_argument("no images in the multipart body");
             }
-        }else{
-            response_status = boost::beast::http::status::not_found;
+        }catch(const std::invalid_argument & e){
             nlohmann::json res_json;
             res_json["status"] = "error";
-            res_json["message"] = "Resource not found";
-            response_body = res_json.dump();
+            res_json["message"] = e.what();
+            return make_json_response(boost::beast::http::status::bad_request, res_json, *req);
         }
 
-        boost::beast::http::response<boost::beast::http::string_body> res{response_status, req.version()};
-        res.set(boost::beast::http::field::server, "AIvoice-Server");
-        res.set(boost::beast::http::field::content_type, "application/json");
-        res.content_length(response_body.size());
-        res.body() = response_body;
-        res.prepare_payload();
+        try{
+            std::string filename = persist_upload(req, "batch_", ".multipart");
+
+            std::vector<std::span<const unsigned char>> images;
+            images.reserve(parts.size());
+            for(const auto & part : parts){
+                images.emplace_back(reinterpret_cast<const unsigned char *>(part.data.data()), part.data.size());
+            }
+
+            std::vector<std::string> inference_results = s_ai_manager.run_image_inference(images);
+
+            nlohmann::json results = nlohmann::json::array();
+            for(size_t i = 0; i < parts.size(); ++i){
+                nlohmann::json item;
+                item["name"] = parts[i].name;
+                item["filename"] = parts[i].filename;
+                item["inference_result"] = inference_results[i];
+                results.push_back(std::move(item));
+            }
+
+            nlohmann::json res_json;
+            res_json["status"] = "ok";
+            res_json["message"] = "Files uploaded successfully.";
+            if(!filename.empty()){
+                res_json["filename"] = filename;
+            }
+            res_json["results"] = std::move(results);
+            return make_json_response(boost::beast::http::status::ok, res_json, *req);
+
+        }catch(const std::exception & e){
+            std::cerr << "Error during batch upload: " << e.what() << std::endl;
+            nlohmann::json res_json;
+            res_json["status"] = "error";
+            res_json["message"] = "Server error during upload.";
+            return make_json_response(boost::beast::http::status::internal_server_error, res_json, *req);
+        }
+    }
+
+    HttpResponse Server::handle_transcribe(const std::shared_ptr<const HttpRequest> & req){
+        try
+        {
+            const std::string & body_content = req->body();
+
+            std::string filename = persist_upload(req, "audio_", ".wav");
+            auto content_type = (*req)[boost::beast::http::field::content_type];
 
-        boost::beast::http::write(stream, res);
+            TranscriptionResult transcription_result = s_ai_manager.transcribe_audio(
+                std::span<const unsigned char>(reinterpret_cast<const unsigned char *>(body_content.data()), body_content.size()),
+                std::string_view(content_type.data(), content_type.size())
+            );
+
+            nlohmann::json res_json;
+            res_json["status"] = "ok";
+            res_json["message"] = "Audio uploaded and processing started.";
+            if(!filename.empty()){
+                res_json["filename"] = filename;
+            }
+            res_json["transcription_result"] = transcription_result.text;
+            if(!transcription_result.report.is_null()){
+                res_json["report"] = std::move(transcription_result.report);
+            }
+            return make_json_response(boost::beast::http::status::ok, res_json, *req);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << "Error during file transcribed: " << e.what() << std::endl;
+            nlohmann::json res_json;
+            res_json["status"] = "error";
+            res_json["message"] = "Server error during transcribed.";
+            return make_json_response(boost::beast::http::status::internal_server_error, res_json, *req);
+        }
     }
 }
\ No newline at end of file
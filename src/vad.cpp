@@ -0,0 +1,246 @@
+//file:: vad.cpp
+#include "include/vad.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iostream>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        // voiced frames: harmonic, so far from a flat (noise) spectrum, and mostly in the speech band
+        const float voiced_max_flatness = 0.45f;
+        const float voiced_min_band_ratio = 0.3f;
+        // fricatives (s, f, sh) cross zero often but, unlike broadband noise
+        // (flatness around 0.56 for a hann window), keep their energy high up
+        const float fricative_min_zcr = 0.25f;
+        const float fricative_max_flatness = 0.35f;
+
+        const std::size_t model_context = 64;
+
+        std::size_t ms_to_frames(int ms, int sample_rate, std::size_t frame_size){
+            std::size_t samples = static_cast<std::size_t>(ms) * sample_rate / 1000;
+            return (samples + frame_size - 1) / frame_size;
+        }
+
+        bool has_input(const Ort::Session & session, const std::string & name, std::size_t * index = nullptr){
+            Ort::AllocatorWithDefaultOptions allocator;
+            for(std::size_t i = 0; i < session.GetInputCount(); ++i){
+                if(name == session.GetInputNameAllocated(i, allocator).get()){
+                    if(index){
+                        *index = i;
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
+    VoiceActivityDetector::VoiceActivityDetector(const VadOptions & options, Ort::Session * model)
+    : v_options(options), v_model(model), v_model_has_state(false), v_sr_rank(0),
+    v_fft(frame_size), v_window(frame_size)
+    {
+        for(std::size_t i = 0; i < frame_size; ++i){
+            v_window[i] = 0.5f * (1.0f - std::cos(2.0f * M_PI * i / (frame_size - 1)));
+        }
+
+        if(v_model){
+            std::size_t sr_index = 0;
+            v_model_has_state = has_input(*v_model, "state");
+            bool recurrent = v_model_has_state || (has_input(*v_model, "h") && has_input(*v_model, "c"));
+            if(!has_input(*v_model, "input") || !has_input(*v_model, "sr", &sr_index) || !recurrent){
+                std::cerr << "VAD model does not look like a Silero export, using the energy detector." << std::endl;
+                v_model = nullptr;
+            }else{
+                v_sr_rank = v_model->GetInputTypeInfo(sr_index).GetTensorTypeAndShapeInfo().GetShape().size();
+            }
+        }
+    }
+
+    const char * VoiceActivityDetector::method() const{
+        return v_model ? "model" : "energy";
+    }
+
+    std::vector<SpeechRegion> VoiceActivityDetector::detect(const float * samples, std::size_t count) const{
+        if(count == 0){
+            return {};
+        }
+        std::vector<bool> speech_frames = v_model ? classify_by_model(samples, count) : classify_by_features(samples, count);
+        return smooth(speech_frames, count);
+    }
+
+    std::vector<bool> VoiceActivityDetector::classify_by_features(const float * samples, std::size_t count) const{
+        const std::size_t frames = (count + frame_size - 1) / frame_size;
+        const std::size_t bins = v_fft.bins();
+        const std::size_t band_low = 300 * frame_size / sample_rate;
+        const std::size_t band_high = 3400 * frame_size / sample_rate;
+
+        std::vector<float> energy_db(frames);
+        std::vector<float> zcr(frames);
+        std::vector<float> flatness(frames);
+        std::vector<float> band_ratio(frames);
+
+        RealFFT::Workspace workspace = v_fft.make_workspace();
+        std::vector<float> frame(frame_size);
+        std::vector<float> magnitude(bins);
+
+        for(std::size_t f = 0; f < frames; ++f){
+            const float * frame_samples = samples + f * frame_size;
+            const std::size_t n = std::min(frame_size, count - f * frame_size);
+
+            float sum_squares = 0.0f;
+            std::size_t crossings = 0;
+            for(std::size_t i = 0; i < n; ++i){
+                sum_squares += frame_samples[i] * frame_samples[i];
+                if(i > 0 && (frame_samples[i] >= 0.0f) != (frame_samples[i - 1] >= 0.0f)){
+                    ++crossings;
+                }
+            }
+            energy_db[f] = 10.0f * std::log10(sum_squares / frame_size + 1e-10f);
+            zcr[f] = static_cast<float>(crossings) / n;
+
+            for(std::size_t i = 0; i < frame_size; ++i){
+                frame[i] = i < n ? frame_samples[i] * v_window[i] : 0.0f;
+            }
+            v_fft.magnitude(frame.data(), magnitude.data(), workspace);
+
+            // DC left out, it says nothing about speech
+            float power_sum = 0.0f;
+            float log_power_sum = 0.0f;
+            float band_sum = 0.0f;
+            for(std::size_t k = 1; k < bins; ++k){
+                float power = magnitude[k] * magnitude[k] + 1e-12f;
+                power_sum += power;
+                log_power_sum += std::log(power);
+                if(k >= band_low && k <= band_high){
+                    band_sum += power;
+                }
+            }
+            const float used_bins = static_cast<float>(bins - 1);
+            flatness[f] = std::exp(log_power_sum / used_bins) / (power_sum / used_bins);
+            band_ratio[f] = band_sum / power_sum;
+        }
+
+        // the quietest tenth of the file is taken as its noise floor
+        std::vector<float> sorted_energy = energy_db;
+        std::nth_element(sorted_energy.begin(), sorted_energy.begin() + frames / 10, sorted_energy.end());
+        const float noise_floor = sorted_energy[frames / 10];
+        const float threshold = std::clamp(noise_floor + v_options.margin_db, v_options.min_db, v_options.max_db);
+
+        std::vector<bool> speech(frames);
+        for(std::size_t f = 0; f < frames; ++f){
+            bool loud = energy_db[f] > threshold;
+            bool voiced = flatness[f] < voiced_max_flatness && band_ratio[f] > voiced_min_band_ratio;
+            bool fricative = zcr[f] > fricative_min_zcr && flatness[f] < fricative_max_flatness;
+            speech[f] = loud && (voiced || fricative);
+        }
+        return speech;
+    }
+
+    std::vector<bool> VoiceActivityDetector::classify_by_model(const float * samples, std::size_t count) const{
+        const std::size_t frames = (count + frame_size - 1) / frame_size;
+        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+
+        // v5 sees the last 64 samples of the previous frame in front of each frame
+        const std::size_t context = v_model_has_state ? model_context : 0;
+        std::vector<float> input(context + frame_size, 0.0f);
+        std::array<int64_t, 2> input_shape = {1, static_cast<int64_t>(input.size())};
+
+        int64_t sr = sample_rate;
+        std::array<int64_t, 1> sr_shape = {1};
+
+        // v5: one [2,1,128] state; v4: h and c, [2,1,64] each
+        std::vector<float> state(v_model_has_state ? 2 * 128 : 2 * 64, 0.0f);
+        std::vector<float> cell(v_model_has_state ? 0 : 2 * 64, 0.0f);
+        std::array<int64_t, 3> state_shape = {2, 1, v_model_has_state ? 128 : 64};
+
+        std::vector<const char*> input_names = {"input", "sr"};
+        std::vector<const char*> output_names = {"output"};
+        if(v_model_has_state){
+            input_names.push_back("state");
+            output_names.push_back("stateN");
+        }else{
+            input_names.push_back("h");
+            input_names.push_back("c");
+            output_names.push_back("hn");
+            output_names.push_back("cn");
+        }
+
+        std::vector<bool> speech(frames);
+        for(std::size_t f = 0; f < frames; ++f){
+            std::copy(input.end() - context, input.end(), input.begin());
+            const std::size_t n = std::min(frame_size, count - f * frame_size);
+            std::copy_n(samples + f * frame_size, n, input.begin() + context);
+            std::fill(input.begin() + context + n, input.end(), 0.0f);
+
+            std::vector<Ort::Value> inputs;
+            inputs.push_back(Ort::Value::CreateTensor<float>(memory_info, input.data(), input.size(), input_shape.data(), input_shape.size()));
+            inputs.push_back(Ort::Value::CreateTensor<int64_t>(memory_info, &sr, 1, sr_shape.data(), v_sr_rank));
+            inputs.push_back(Ort::Value::CreateTensor<float>(memory_info, state.data(), state.size(), state_shape.data(), state_shape.size()));
+            if(!v_model_has_state){
+                inputs.push_back(Ort::Value::CreateTensor<float>(memory_info, cell.data(), cell.size(), state_shape.data(), state_shape.size()));
+            }
+
+            auto outputs = v_model->Run(
+                Ort::RunOptions{nullptr},
+                input_names.data(),
+                inputs.data(),
+                inputs.size(),
+                output_names.data(),
+                output_names.size()
+            );
+
+            speech[f] = outputs[0].GetTensorData<float>()[0] >= v_options.model_threshold;
+            std::copy_n(outputs[1].GetTensorData<float>(), state.size(), state.begin());
+            if(!v_model_has_state){
+                std::copy_n(outputs[2].GetTensorData<float>(), cell.size(), cell.begin());
+            }
+        }
+        return speech;
+    }
+
+    std::vector<SpeechRegion> VoiceActivityDetector::smooth(const std::vector<bool> & speech_frames, std::size_t count) const{
+        const std::size_t min_silence = ms_to_frames(v_options.min_silence_ms, sample_rate, frame_size);
+        const std::size_t min_speech = ms_to_frames(v_options.min_speech_ms, sample_rate, frame_size);
+        const std::size_t padding = static_cast<std::size_t>(v_options.padding_ms) * sample_rate / 1000;
+
+        // runs of speech frames, with short pauses bridged
+        std::vector<std::pair<std::size_t, std::size_t>> runs;
+        for(std::size_t f = 0; f < speech_frames.size(); ++f){
+            if(!speech_frames[f]){
+                continue;
+            }
+            std::size_t begin = f;
+            while(f < speech_frames.size() && speech_frames[f]){
+                ++f;
+            }
+            if(!runs.empty() && begin - runs.back().second < min_silence){
+                runs.back().second = f;
+            }else{
+                runs.emplace_back(begin, f);
+            }
+        }
+
+        std::vector<SpeechRegion> regions;
+        for(const auto & run : runs){
+            if(run.second - run.first < min_speech){
+                continue;
+            }
+            std::size_t begin = run.first * frame_size;
+            std::size_t end = std::min(run.second * frame_size, count);
+            begin = begin > padding ? begin - padding : 0;
+            end = std::min(end + padding, count);
+
+            if(!regions.empty() && begin <= regions.back().end){
+                regions.back().end = std::max(regions.back().end, end);
+            }else{
+                regions.push_back({begin, end});
+            }
+        }
+        return regions;
+    }
+}
@@ -0,0 +1,533 @@
+//file:: whisper_decoder.cpp
+#include "include/whisper_decoder.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+
+namespace AIvoice{
+
+    namespace{
+
+        const std::string past_prefix = "past_key_values";
+        const std::string present_prefix = "present";
+        // added by tools/trim_decoder_logits.py
+        const std::string positions_input = "last_positions";
+
+        // what a decoder taking last_positions gathers per row: position 0, the
+        // start of transcript whose logits give the no-speech probability, when
+        // `with_start`, then the row's last position
+        std::vector<int64_t> gathered_positions(const std::vector<int64_t> & last_positions, bool with_start){
+            std::vector<int64_t> positions;
+            positions.reserve(last_positions.size() * 2);
+            for(int64_t last : last_positions){
+                if(with_start){
+                    positions.push_back(0);
+                }
+                positions.push_back(last);
+            }
+            return positions;
+        }
+
+        std::vector<std::string> input_names(const Ort::Session & session){
+            Ort::AllocatorWithDefaultOptions allocator;
+            std::vector<std::string> names;
+            for(size_t i = 0; i < session.GetInputCount(); ++i){
+                names.emplace_back(session.GetInputNameAllocated(i, allocator).get());
+            }
+            return names;
+        }
+
+        std::vector<std::string> output_names(const Ort::Session & session){
+            Ort::AllocatorWithDefaultOptions allocator;
+            std::vector<std::string> names;
+            for(size_t i = 0; i < session.GetOutputCount(); ++i){
+                names.emplace_back(session.GetOutputNameAllocated(i, allocator).get());
+            }
+            return names;
+        }
+
+        bool contains(const std::vector<std::string> & names, const std::string & name){
+            return std::find(names.begin(), names.end(), name) != names.end();
+        }
+
+        // [rows, L, vocab] logits: L and vocab
+        std::pair<int64_t, int64_t> logits_dims(const Ort::Value & logits){
+            auto shape = logits.GetTensorTypeAndShapeInfo().GetShape();
+            const int64_t length = shape.size() >= 2 ? shape[shape.size() - 2] : 1;
+            return {length, shape.back()};
+        }
+
+        // greedy() stops at eot and max_length only
+        DecodeGuardOptions unguarded(){
+            DecodeGuardOptions options;
+            options.ngram_size = 0;
+            options.max_compression_ratio = 0.0f;
+            options.min_avg_logprob = 0.0f;
+            options.no_speech_threshold = 1.0f;
+            return options;
+        }
+
+        Ort::MemoryInfo cpu_memory_info(){
+            return Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        }
+    }
+
+    //a fixed seed, so a chunk samples the same fallback tokens every time
+    WhisperDecoder::Workspace::Workspace()
+    : memory_info(cpu_memory_info()), rng(5489u)
+    {
+    }
+
+    void WhisperDecoder::Workspace::release(){
+        if(session){
+            binding.ClearBoundInputs();
+            binding.ClearBoundOutputs();
+        }
+        cross_entries.clear();
+        rows = 0;
+        length = 0;
+    }
+
+    WhisperDecoder::WhisperDecoder(Ort::Session & decoder, Ort::Session * decoder_with_past, LogitsProcessor logits)
+    : d_decoder(decoder), d_decoder_with_past(decoder_with_past), d_logits(std::move(logits)), d_with_past_takes_encoder(false),
+    d_decoder_takes_positions(contains(input_names(decoder), positions_input))
+    {
+        if(d_decoder_takes_positions){
+            std::cout << "Whisper decoder returns last-position logits only." << std::endl;
+        }
+        std::cout << "Whisper logits processor runs the " << LogitsProcessor::name(d_logits.kernel()) << " kernel." << std::endl;
+        if(d_decoder_with_past && !detect_cache_layout()){
+            std::cerr << "decoder_with_past does not match the decoder, decoding without the KV cache." << std::endl;
+            d_decoder_with_past = nullptr;
+            d_past_names.clear();
+            d_present_names.clear();
+            d_self_attention.clear();
+            d_with_past_takes_encoder = false;
+        }
+        if(d_decoder_with_past){
+            d_first_output_names.push_back("logits");
+            for(const auto & name : d_present_names){
+                d_first_output_names.push_back(name.c_str());
+            }
+
+            std::cout << "Whisper decoder uses the KV cache (" << d_past_names.size() << " cache tensors, "
+                      << d_self_attention.size() << " updated per step)." << std::endl;
+        }
+    }
+
+    bool WhisperDecoder::detect_cache_layout(){
+        const auto decoder_outputs = output_names(d_decoder);
+        const auto with_past_inputs = input_names(*d_decoder_with_past);
+        const auto with_past_outputs = output_names(*d_decoder_with_past);
+
+        for(const auto & name : with_past_inputs){
+            if(name == "input_ids"){
+                continue;
+            }
+            if(name == "encoder_hidden_states"){
+                d_with_past_takes_encoder = true;
+                continue;
+            }
+            if(name.rfind(past_prefix, 0) != 0){
+                // e.g. the use_cache_branch flag of a merged export
+                std::cerr << "decoder_with_past has an unsupported input " << name << std::endl;
+                return false;
+            }
+
+            std::string present = present_prefix + name.substr(past_prefix.size());
+            if(!contains(decoder_outputs, present)){
+                std::cerr << "decoder has no " << present << " output for " << name << std::endl;
+                return false;
+            }
+            if(contains(with_past_outputs, present)){
+                d_self_attention.push_back(d_past_names.size());
+            }
+            d_past_names.push_back(name);
+            d_present_names.push_back(std::move(present));
+        }
+
+        return !d_self_attention.empty() && contains(with_past_outputs, "logits");
+    }
+
+    bool WhisperDecoder::uses_cache() const{
+        return d_decoder_with_past != nullptr;
+    }
+
+    std::vector<int64_t> WhisperDecoder::greedy(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length) const{
+        Workspace workspace;
+        return greedy(encoder_output, prompt, eot, max_length, workspace);
+    }
+
+    std::vector<int64_t> WhisperDecoder::greedy(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length, Workspace & workspace) const{
+        return attempt(encoder_output, prompt, eot, max_length, 0, 0.0f, unguarded(), workspace).tokens;
+    }
+
+    DecodeResult WhisperDecoder::decode(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length, const DecodeGuardOptions & guard, Workspace & workspace) const{
+        DecodeResult result = attempt(encoder_output, prompt, eot, max_length, 0, 0.0f, guard, workspace);
+        for(float temperature = next_fallback_temperature(guard, result); temperature >= 0.0f; temperature = next_fallback_temperature(guard, result)){
+            result = merge_attempts(std::move(result), attempt(encoder_output, prompt, eot, max_length, result.attempts, temperature, guard, workspace));
+        }
+        return result;
+    }
+
+    bool WhisperDecoder::steps_need_encoder_states() const{
+        return !d_decoder_with_past || d_with_past_takes_encoder;
+    }
+
+    const LogitsProcessor & WhisperDecoder::logits_processor() const{
+        return d_logits;
+    }
+
+    std::vector<int64_t> WhisperDecoder::greedy_full(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length) const{
+        Workspace workspace;
+        std::vector<int64_t> input_ids = prompt;
+        std::vector<int64_t> output_tokens;
+        const std::vector<int64_t> prompt_length = {static_cast<int64_t>(prompt.size())};
+
+        for(int i = 0; i < max_length; ++i){
+            std::vector<int64_t> last_position = {static_cast<int64_t>(input_ids.size()) - 1};
+            int64_t next_token = full_step(encoder_output, input_ids, 1, last_position, prompt_length, {}, workspace).tokens.front();
+            output_tokens.push_back(next_token);
+            if(next_token == eot){
+                break;
+            }
+            input_ids.push_back(next_token);
+        }
+
+        return output_tokens;
+    }
+
+    DecodeResult WhisperDecoder::attempt(const Ort::Value & encoder_output, const std::vector<int64_t> & prompt, int64_t eot, int max_length, int number, float temperature, const DecodeGuardOptions & guard_options, Workspace & workspace) const{
+        DecodeGuard guard(guard_options, eot, max_length, number);
+        std::vector<int64_t> generated;
+        if(max_length <= 0){
+            return guard.result(std::move(generated), temperature);
+        }
+        generated.reserve(max_length);
+
+        const std::array<float, 1> temperatures = {temperature};
+        std::vector<int64_t> input_ids = prompt;
+        if(d_decoder_with_past){
+            StepTokens step = first_step(encoder_output, input_ids, 1, max_length, temperatures, workspace);
+            generated.push_back(step.tokens.front());
+            while(!guard.push(generated, step.logprobs.front(), step.no_speech_probs.front())){
+                step = next_step(workspace);
+                generated.push_back(step.tokens.front());
+            }
+            workspace.release();
+        }else{
+            const std::vector<int64_t> prompt_length = {static_cast<int64_t>(prompt.size())};
+            while(true){
+                std::vector<int64_t> last_position = {static_cast<int64_t>(input_ids.size()) - 1};
+                StepTokens step = full_step(encoder_output, input_ids, 1, last_position, prompt_length, temperatures, workspace);
+                generated.push_back(step.tokens.front());
+                if(guard.push(generated, step.logprobs.front(), step.no_speech_probs.front())){
+                    break;
+                }
+                input_ids.push_back(step.tokens.front());
+            }
+        }
+        return guard.result(std::move(generated), temperature);
+    }
+
+    WhisperDecoder::StepTokens WhisperDecoder::first_step(const Ort::Value & encoder_states, std::vector<int64_t> & input_ids, size_t rows, int max_length, std::span<const float> temperatures, Workspace & workspace) const{
+        const int64_t prompt_length = static_cast<int64_t>(input_ids.size() / rows);
+
+        //the whole prompt through the plain decoder, which also returns every K/V
+        std::vector<int64_t> last_positions(rows, prompt_length - 1);
+        auto outputs = run_decoder(encoder_states, input_ids, rows, d_decoder_takes_positions ? gathered_positions(last_positions, true) : last_positions, d_first_output_names);
+        prepare_workspace(workspace, outputs, rows, prompt_length + max_length);
+
+        //self attention K/V into the first buffer, cross attention K/V kept as returned
+        workspace.rows = rows;
+        workspace.length = prompt_length;
+        workspace.current = 0;
+        workspace.cross_entries.clear();
+        for(size_t i = 0; i < d_past_names.size(); ++i){
+            workspace.cross_entries.emplace_back(nullptr);
+        }
+        size_t entry = 0;
+        for(size_t i = 0; i < d_past_names.size(); ++i){
+            Ort::Value & present = outputs[1 + i];
+            if(entry < d_self_attention.size() && d_self_attention[entry] == i){
+                const size_t count = present.GetTensorTypeAndShapeInfo().GetElementCount();
+                std::copy_n(present.GetTensorData<float>(), count, workspace.self_entries[entry].buffers[0].data());
+                ++entry;
+            }else{
+                workspace.cross_entries[i] = std::move(present);
+            }
+        }
+
+        //the rows keep their temperatures until they leave the batch
+        std::fill_n(workspace.temperatures.begin(), rows, 0.0f);
+        std::copy_n(temperatures.begin(), std::min(rows, temperatures.size()), workspace.temperatures.begin());
+
+        //chosen straight into the tokens buffer, the next step's input_ids
+        const auto [length, vocab_size] = logits_dims(outputs[0]);
+        const std::vector<uint8_t> first_token(rows, 1);
+        StepTokens step = choose_tokens(outputs[0].GetTensorData<float>(), rows, length, vocab_size, d_decoder_takes_positions ? nullptr : last_positions.data(), first_token.data(), workspace.temperatures.data(), workspace);
+        bind_batch(workspace, encoder_states);
+        return step;
+    }
+
+    WhisperDecoder::StepTokens WhisperDecoder::next_step(Workspace & workspace) const{
+        if(workspace.length >= workspace.max_length){
+            throw std::length_error("decoder workspace is full, first_step was given a smaller max_length");
+        }
+
+        //the cache is read from one buffer and the grown cache written to the other
+        const int next = 1 - workspace.current;
+        for(size_t entry = 0; entry < d_self_attention.size(); ++entry){
+            const size_t index = d_self_attention[entry];
+            workspace.binding.BindInput(d_past_names[index].c_str(), self_view(workspace, entry, workspace.current, workspace.length));
+            workspace.binding.BindOutput(d_present_names[index].c_str(), self_view(workspace, entry, next, workspace.length + 1));
+        }
+
+        d_decoder_with_past->Run(workspace.run_options, workspace.binding);
+        workspace.current = next;
+        ++workspace.length;
+
+        //the tokens buffer is also the next step's input_ids
+        return choose_tokens(workspace.logits.data(), workspace.rows, 1, workspace.vocab_size, nullptr, nullptr, workspace.temperatures.data(), workspace);
+    }
+
+    void WhisperDecoder::keep_rows(const std::vector<size_t> & rows, const Ort::Value & encoder_states, Workspace & workspace) const{
+        //rows only move towards the front, so copying in order never overwrites one still to move
+        for(size_t i = 0; i < rows.size(); ++i){
+            workspace.tokens[i] = workspace.tokens[rows[i]];
+            workspace.temperatures[i] = workspace.temperatures[rows[i]];
+        }
+        for(auto & entry : workspace.self_entries){
+            const size_t row_size = static_cast<size_t>(entry.heads * workspace.length * entry.head_dim);
+            float * cache = entry.buffers[workspace.current].data();
+            for(size_t i = 0; i < rows.size(); ++i){
+                if(rows[i] != i){
+                    std::copy_n(cache + rows[i] * row_size, row_size, cache + i * row_size);
+                }
+            }
+        }
+        for(auto & entry : workspace.cross_entries){
+            if(entry){
+                entry = select_rows(entry, rows);
+            }
+        }
+
+        workspace.rows = rows.size();
+        if(workspace.rows > 0){
+            bind_batch(workspace, encoder_states);
+        }
+    }
+
+    void WhisperDecoder::prepare_workspace(Workspace & workspace, const std::vector<Ort::Value> & outputs, size_t rows, int64_t max_length) const{
+        if(workspace.session != d_decoder_with_past){
+            workspace.binding = Ort::IoBinding(*d_decoder_with_past);
+            workspace.session = d_decoder_with_past;
+            workspace.max_rows = 0;
+        }
+
+        const int64_t vocab_size = outputs[0].GetTensorTypeAndShapeInfo().GetShape().back();
+        bool fits = workspace.max_rows >= rows && workspace.max_length >= max_length
+                 && workspace.vocab_size == vocab_size && workspace.self_entries.size() == d_self_attention.size();
+        for(size_t entry = 0; fits && entry < d_self_attention.size(); ++entry){
+            auto shape = outputs[1 + d_self_attention[entry]].GetTensorTypeAndShapeInfo().GetShape();
+            fits = workspace.self_entries[entry].heads == shape[1] && workspace.self_entries[entry].head_dim == shape[3];
+        }
+        if(fits){
+            return;
+        }
+
+        //grown, never shrunk: the views made so far are dropped with the old buffers
+        workspace.binding.ClearBoundInputs();
+        workspace.binding.ClearBoundOutputs();
+        workspace.max_rows = std::max(workspace.max_rows, rows);
+        workspace.max_length = std::max(workspace.max_length, max_length);
+        workspace.vocab_size = vocab_size;
+
+        workspace.tokens.assign(workspace.max_rows, 0);
+        workspace.logprobs.assign(workspace.max_rows, 0.0f);
+        workspace.no_speech_probs.assign(workspace.max_rows, 0.0f);
+        workspace.temperatures.assign(workspace.max_rows, 0.0f);
+        workspace.logits.assign(workspace.max_rows * vocab_size, 0.0f);
+        workspace.token_views.clear();
+        workspace.logits_views.clear();
+        for(size_t i = 0; i < workspace.max_rows; ++i){
+            workspace.token_views.emplace_back(nullptr);
+            workspace.logits_views.emplace_back(nullptr);
+        }
+
+        const size_t view_count = static_cast<size_t>(workspace.max_length + 1) * workspace.max_rows;
+        workspace.self_entries.clear();
+        workspace.self_entries.resize(d_self_attention.size());
+        for(size_t entry = 0; entry < d_self_attention.size(); ++entry){
+            //present.* is [rows, heads, length, head_dim]
+            auto shape = outputs[1 + d_self_attention[entry]].GetTensorTypeAndShapeInfo().GetShape();
+            Workspace::SelfEntry & self = workspace.self_entries[entry];
+            self.heads = shape[1];
+            self.head_dim = shape[3];
+            for(int buffer = 0; buffer < 2; ++buffer){
+                self.buffers[buffer].assign(workspace.max_rows * self.heads * workspace.max_length * self.head_dim, 0.0f);
+                self.views[buffer].reserve(view_count);
+                for(size_t i = 0; i < view_count; ++i){
+                    self.views[buffer].emplace_back(nullptr);
+                }
+            }
+        }
+    }
+
+    void WhisperDecoder::bind_batch(Workspace & workspace, const Ort::Value & encoder_states) const{
+        workspace.binding.BindInput("input_ids", token_view(workspace));
+        if(d_with_past_takes_encoder){
+            workspace.binding.BindInput("encoder_hidden_states", encoder_states);
+        }
+        for(size_t i = 0; i < workspace.cross_entries.size(); ++i){
+            if(workspace.cross_entries[i]){
+                workspace.binding.BindInput(d_past_names[i].c_str(), workspace.cross_entries[i]);
+            }
+        }
+        workspace.binding.BindOutput("logits", logits_view(workspace));
+    }
+
+    Ort::Value & WhisperDecoder::self_view(Workspace & workspace, size_t entry, int buffer, int64_t length) const{
+        Workspace::SelfEntry & self = workspace.self_entries[entry];
+        Ort::Value & view = self.views[buffer][static_cast<size_t>(length) * workspace.max_rows + workspace.rows - 1];
+        if(!view){
+            std::array<int64_t, 4> shape = {static_cast<int64_t>(workspace.rows), self.heads, length, self.head_dim};
+            view = Ort::Value::CreateTensor<float>(
+                workspace.memory_info, self.buffers[buffer].data(), workspace.rows * self.heads * length * self.head_dim, shape.data(), shape.size()
+            );
+        }
+        return view;
+    }
+
+    Ort::Value & WhisperDecoder::token_view(Workspace & workspace) const{
+        Ort::Value & view = workspace.token_views[workspace.rows - 1];
+        if(!view){
+            std::array<int64_t, 2> shape = {static_cast<int64_t>(workspace.rows), 1};
+            view = Ort::Value::CreateTensor<int64_t>(workspace.memory_info, workspace.tokens.data(), workspace.rows, shape.data(), shape.size());
+        }
+        return view;
+    }
+
+    Ort::Value & WhisperDecoder::logits_view(Workspace & workspace) const{
+        Ort::Value & view = workspace.logits_views[workspace.rows - 1];
+        if(!view){
+            std::array<int64_t, 3> shape = {static_cast<int64_t>(workspace.rows), 1, workspace.vocab_size};
+            view = Ort::Value::CreateTensor<float>(workspace.memory_info, workspace.logits.data(), workspace.rows * workspace.vocab_size, shape.data(), shape.size());
+        }
+        return view;
+    }
+
+    WhisperDecoder::StepTokens WhisperDecoder::choose_tokens(const float * logits, size_t rows, int64_t length, int64_t vocab_size, const int64_t * positions, const uint8_t * first_token, const float * temperatures, Workspace & workspace) const{
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        for(size_t row = 0; row < rows; ++row){
+            const int64_t position = positions ? positions[row] : length - 1;
+            const bool first = first_token && first_token[row];
+            const float * row_logits = logits + static_cast<int64_t>(row) * length * vocab_size;
+            //fallbacks sample among the most likely tokens, the tail past them is negligible
+            SamplingOptions sampling;
+            sampling.temperature = temperatures ? temperatures[row] : 0.0f;
+            sampling.top_k = LogitsProcessor::max_top_k;
+            const float draw = sampling.temperature > 0.0f ? uniform(workspace.rng) : 0.0f;
+            //the no-speech probability is read at the start of transcript, in the
+            //same pass when the prompt is nothing else
+            float no_speech_prob = 0.0f;
+            TokenChoice choice = d_logits.choose(row_logits + position * vocab_size, vocab_size, first, sampling, draw, first && position == 0 ? &no_speech_prob : nullptr);
+            if(first && position != 0){
+                no_speech_prob = d_logits.no_speech_prob(row_logits, vocab_size);
+            }
+            workspace.tokens[row] = choice.token;
+            workspace.logprobs[row] = choice.logprob;
+            workspace.no_speech_probs[row] = no_speech_prob;
+        }
+        return StepTokens{
+            std::span<const int64_t>(workspace.tokens.data(), rows),
+            std::span<const float>(workspace.logprobs.data(), rows),
+            std::span<const float>(workspace.no_speech_probs.data(), rows)
+        };
+    }
+
+    WhisperDecoder::StepTokens WhisperDecoder::full_step(const Ort::Value & encoder_states, std::vector<int64_t> & input_ids, size_t rows, const std::vector<int64_t> & last_positions, const std::vector<int64_t> & prompt_lengths, std::span<const float> temperatures, Workspace & workspace) const{
+        std::vector<uint8_t> first_token(rows);
+        bool any_first = false;
+        for(size_t row = 0; row < rows; ++row){
+            first_token[row] = last_positions[row] + 1 == prompt_lengths[row];
+            any_first = any_first || first_token[row];
+        }
+
+        const std::vector<const char*> output_names = {"logits"};
+        auto outputs = run_decoder(encoder_states, input_ids, rows, d_decoder_takes_positions ? gathered_positions(last_positions, any_first) : last_positions, output_names);
+
+        //the uncached path never binds the tokens buffer, growing it cannot strand a view
+        if(workspace.tokens.size() < rows){
+            workspace.max_rows = 0;
+            workspace.tokens.resize(rows);
+            workspace.logprobs.resize(rows);
+            workspace.no_speech_probs.resize(rows);
+        }
+        const auto [length, vocab_size] = logits_dims(outputs[0]);
+        return choose_tokens(outputs[0].GetTensorData<float>(), rows, length, vocab_size, d_decoder_takes_positions ? nullptr : last_positions.data(), first_token.data(), temperatures.empty() ? nullptr : temperatures.data(), workspace);
+    }
+
+    std::vector<Ort::Value> WhisperDecoder::run_decoder(const Ort::Value & encoder_states, std::vector<int64_t> & input_ids, size_t rows, const std::vector<int64_t> & positions, const std::vector<const char*> & output_names) const{
+        Ort::MemoryInfo memory_info = cpu_memory_info();
+
+        //bound rather than passed to Run(), which takes the encoder output as is
+        std::array<int64_t, 2> input_shape = {static_cast<int64_t>(rows), static_cast<int64_t>(input_ids.size() / rows)};
+        std::array<int64_t, 2> positions_shape = {static_cast<int64_t>(rows), static_cast<int64_t>(positions.size() / rows)};
+        Ort::Value ids_tensor = Ort::Value::CreateTensor<int64_t>(memory_info, input_ids.data(), input_ids.size(), input_shape.data(), input_shape.size());
+        Ort::Value positions_tensor{nullptr};
+
+        Ort::IoBinding binding(d_decoder);
+        binding.BindInput("input_ids", ids_tensor);
+        binding.BindInput("encoder_hidden_states", encoder_states);
+        if(d_decoder_takes_positions){
+            positions_tensor = Ort::Value::CreateTensor<int64_t>(memory_info, const_cast<int64_t *>(positions.data()), positions.size(), positions_shape.data(), positions_shape.size());
+            binding.BindInput(positions_input.c_str(), positions_tensor);
+        }
+        for(const char * name : output_names){
+            binding.BindOutput(name, memory_info);
+        }
+
+        d_decoder.Run(Ort::RunOptions{nullptr}, binding);
+        return binding.GetOutputValues();
+    }
+
+    Ort::Value WhisperDecoder::concat_rows(const std::vector<const Ort::Value *> & tensors){
+        std::vector<int64_t> shape = tensors.front()->GetTensorTypeAndShapeInfo().GetShape();
+        shape[0] = 0;
+        for(const Ort::Value * tensor : tensors){
+            shape[0] += tensor->GetTensorTypeAndShapeInfo().GetShape().front();
+        }
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        Ort::Value joined = Ort::Value::CreateTensor<float>(allocator, shape.data(), shape.size());
+        float * out = joined.GetTensorMutableData<float>();
+        for(const Ort::Value * tensor : tensors){
+            size_t count = tensor->GetTensorTypeAndShapeInfo().GetElementCount();
+            std::copy_n(tensor->GetTensorData<float>(), count, out);
+            out += count;
+        }
+        return joined;
+    }
+
+    Ort::Value WhisperDecoder::select_rows(const Ort::Value & tensor, const std::vector<size_t> & rows){
+        auto info = tensor.GetTensorTypeAndShapeInfo();
+        std::vector<int64_t> shape = info.GetShape();
+        const size_t row_size = shape[0] > 0 ? info.GetElementCount() / shape[0] : 0;
+        shape[0] = static_cast<int64_t>(rows.size());
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        Ort::Value selected = Ort::Value::CreateTensor<float>(allocator, shape.data(), shape.size());
+        const float * in = tensor.GetTensorData<float>();
+        float * out = selected.GetTensorMutableData<float>();
+        for(size_t row : rows){
+            std::copy_n(in + row * row_size, row_size, out);
+            out += row_size;
+        }
+        return selected;
+    }
+}
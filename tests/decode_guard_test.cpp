@@ -0,0 +1,94 @@
+//file:: decode_guard_test.cpp
+// DecodeGuard's stops on made-up token streams, no models needed
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "include/decode_guard.hpp"
+
+
+namespace{
+
+    constexpr int64_t eot = 0;
+
+    int failures = 0;
+
+    void expect(bool ok, const char * what){
+        if(!ok){
+            std::cerr << "failed: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    // tokens 1, 2, 3, ... each at `logprob`, with `no_speech_prob` at the
+    // first, pushed until the guard stops
+    AIvoice::DecodeResult feed(const AIvoice::DecodeGuardOptions & options, int max_length, float logprob, float no_speech_prob, int attempt = 0){
+        AIvoice::DecodeGuard guard(options, eot, max_length, attempt);
+        std::vector<int64_t> generated;
+        do{
+            generated.push_back(static_cast<int64_t>(generated.size()) + 1);
+        }while(!guard.push(generated, logprob, no_speech_prob));
+        return guard.result(std::move(generated), 0.0f);
+    }
+
+    void low_logprob_without_retry_keeps_decoding(){
+        AIvoice::DecodeGuardOptions options;
+        AIvoice::DecodeResult result = feed(options, 40, -3.0f, 0.0f);
+        expect(result.stop_reason == AIvoice::StopReason::max_length, "a low logprob without a fallback runs to max_length");
+        expect(result.tokens.size() == 40, "a low logprob without a fallback keeps every token");
+    }
+
+    void low_logprob_with_retry_stops(){
+        AIvoice::DecodeGuardOptions options;
+        options.fallback_temperatures = {0.2f, 0.4f};
+        AIvoice::DecodeResult result = feed(options, 40, -3.0f, 0.0f);
+        expect(result.stop_reason == AIvoice::StopReason::low_logprob, "a low logprob with a fallback left stops");
+        expect(result.steps == options.min_tokens, "the logprob check waits for min_tokens");
+        expect(AIvoice::next_fallback_temperature(options, result) == 0.2f, "the stop moves on to the first fallback temperature");
+
+        result = feed(options, 40, -3.0f, 0.0f, 2);
+        expect(result.stop_reason == AIvoice::StopReason::max_length, "the last attempt is not cut for its logprob");
+    }
+
+    void no_speech_keeps_confident_text(){
+        AIvoice::DecodeGuardOptions options;
+        AIvoice::DecodeResult result = feed(options, 20, -0.2f, 0.9f);
+        expect(result.stop_reason == AIvoice::StopReason::max_length, "a high no-speech probability alone does not stop a chunk");
+        expect(result.tokens.size() == 20, "confident tokens keep their text despite a high no-speech probability");
+        expect(result.no_speech_prob == 0.9f, "the no-speech probability of the first step is reported");
+    }
+
+    void no_speech_drops_unsure_text(){
+        AIvoice::DecodeGuardOptions options;
+        AIvoice::DecodeResult result = feed(options, 20, -2.0f, 0.9f);
+        expect(result.stop_reason == AIvoice::StopReason::no_speech, "a high no-speech probability and a low logprob is silence");
+        expect(result.tokens.empty(), "silence keeps no text");
+        expect(result.steps == 20, "the chunk is decoded before the no-speech rule applies");
+        expect(!result.stopped_early(), "silence is not decoded again");
+
+        result = feed(options, 20, -2.0f, 0.3f);
+        expect(result.stop_reason == AIvoice::StopReason::max_length && result.tokens.size() == 20, "a low no-speech probability keeps unsure text");
+    }
+
+    void compression_check_is_off_by_default(){
+        AIvoice::DecodeGuardOptions options;
+        options.ngram_size = 0;
+        AIvoice::DecodeGuard guard(options, eot, 64);
+        std::vector<int64_t> generated;
+        bool stopped = false;
+        while(!stopped){
+            generated.push_back(static_cast<int64_t>(generated.size() % 5) + 1);
+            stopped = guard.push(generated, -0.1f, 0.0f);
+        }
+        expect(guard.stop_reason() == AIvoice::StopReason::max_length, "the compression check is off by default");
+    }
+}
+
+int main(){
+    low_logprob_without_retry_keeps_decoding();
+    low_logprob_with_retry_stops();
+    no_speech_keeps_confident_text();
+    no_speech_drops_unsure_text();
+    compression_check_is_off_by_default();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
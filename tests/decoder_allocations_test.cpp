@@ -0,0 +1,175 @@
+//file:: decoder_allocations_test.cpp
+// a cached decoder step on a warmed-up workspace allocates nothing on top of
+// what onnxruntime itself allocates for the same binds and run. every
+// operator new of this process is counted, so the counting allocator lives
+// here and never in the server.
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+#include <onnxruntime/onnxruntime_cxx_api.h>
+
+#include "include/whisper_decoder.hpp"
+
+
+namespace{
+
+    std::atomic<bool> counting{false};
+    std::atomic<std::size_t> allocations{0};
+
+    // ctest's SKIP_RETURN_CODE, for a tree without the tiny models
+    constexpr int skipped = 77;
+}
+
+void * operator new(std::size_t size){
+    if(counting.load(std::memory_order_relaxed)){
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if(void * memory = std::malloc(size == 0 ? 1 : size)){
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void * memory) noexcept{
+    std::free(memory);
+}
+
+void operator delete(void * memory, std::size_t) noexcept{
+    std::free(memory);
+}
+
+
+namespace{
+
+    template<typename Fn>
+    std::size_t count_allocations(Fn && fn){
+        allocations = 0;
+        counting = true;
+        fn();
+        counting = false;
+        return allocations.load();
+    }
+}
+
+int main(int argc, char ** argv){
+    const std::filesystem::path model_dir = argc > 1 ? argv[1] : "tiny_whisper";
+    const std::string decoder_path = (model_dir / "decoder.onnx").string();
+    const std::string decoder_with_past_path = (model_dir / "decoder_with_past.onnx").string();
+    if(!std::filesystem::exists(decoder_path) || !std::filesystem::exists(decoder_with_past_path)){
+        std::cout << "no tiny Whisper models in " << model_dir << " (tests/make_tiny_whisper.py), skipping" << std::endl;
+        return skipped;
+    }
+
+    // stand-ins for sot and notimestamps, the prompt transcriptions start with
+    const std::vector<int64_t> prompt = {1, 2};
+    const int prompt_length = static_cast<int>(prompt.size());
+    const int max_length = 128;
+    const int warm_steps = 8;
+    const int measured_steps = 64;
+
+    try{
+        Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "decoder_allocations_test");
+        Ort::SessionOptions session_options;
+        session_options.SetIntraOpNumThreads(1);
+        session_options.SetInterOpNumThreads(1);
+        Ort::Session decoder(env, decoder_path.c_str(), session_options);
+        Ort::Session decoder_with_past(env, decoder_with_past_path.c_str(), session_options);
+
+        AIvoice::WhisperDecoder whisper(decoder, &decoder_with_past);
+        if(!whisper.uses_cache()){
+            std::cerr << "the tiny decoder pair was not taken for a KV cache layout" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        std::vector<float> encoder_data(6 * 12);
+        for(std::size_t i = 0; i < encoder_data.size(); ++i){
+            encoder_data[i] = static_cast<float>(i % 7) * 0.25f - 0.75f;
+        }
+        std::array<int64_t, 3> encoder_shape = {1, 6, 12};
+        Ort::Value encoder_states = Ort::Value::CreateTensor<float>(
+            memory_info, encoder_data.data(), encoder_data.size(), encoder_shape.data(), encoder_shape.size()
+        );
+
+        //the decoder's share: warm steps on a workspace that already decoded max_length
+        //tokens, so its buffers and every (rows, length) view the steps use exist
+        AIvoice::WhisperDecoder::Workspace workspace;
+        whisper.greedy(encoder_states, prompt, -1, max_length, workspace);
+
+        std::vector<int64_t> input_ids = prompt;
+        whisper.first_step(encoder_states, input_ids, 1, max_length, {}, workspace);
+        for(int i = 0; i < warm_steps; ++i){
+            whisper.next_step(workspace);
+        }
+        const std::size_t decoder_allocations = count_allocations([&](){
+            for(int i = 0; i < measured_steps; ++i){
+                whisper.next_step(workspace);
+            }
+        });
+        workspace.release();
+
+        //onnxruntime's share: the same binds and runs, on tensors made up front
+        std::array<int64_t, 2> token_shape = {1, 1};
+        std::vector<int64_t> token = {1};
+        Ort::Value token_tensor = Ort::Value::CreateTensor<int64_t>(memory_info, token.data(), token.size(), token_shape.data(), token_shape.size());
+        const char * input_names[] = {"input_ids", "encoder_hidden_states"};
+        const char * output_names[] = {"logits", "present.0.decoder.key", "present.0.encoder.key"};
+        std::array<Ort::Value, 2> inputs = {std::move(token_tensor), std::move(encoder_states)};
+        auto first = decoder.Run(Ort::RunOptions{nullptr}, input_names, inputs.data(), inputs.size(), output_names, 3);
+        const int64_t vocab_size = first[0].GetTensorTypeAndShapeInfo().GetShape().back();
+        const int64_t head_dim = first[1].GetTensorTypeAndShapeInfo().GetShape().back();
+
+        std::vector<float> logits(vocab_size);
+        std::array<int64_t, 3> logits_shape = {1, 1, vocab_size};
+        Ort::Value logits_tensor = Ort::Value::CreateTensor<float>(memory_info, logits.data(), logits.size(), logits_shape.data(), logits_shape.size());
+        std::array<std::vector<float>, 2> cache;
+        std::array<std::vector<Ort::Value>, 2> cache_views;
+        for(int buffer = 0; buffer < 2; ++buffer){
+            cache[buffer].assign(static_cast<std::size_t>(prompt_length + max_length) * head_dim, 0.0f);
+            for(int64_t length = 0; length <= prompt_length + max_length; ++length){
+                std::array<int64_t, 4> shape = {1, 1, length, head_dim};
+                cache_views[buffer].push_back(Ort::Value::CreateTensor<float>(memory_info, cache[buffer].data(), length * head_dim, shape.data(), shape.size()));
+            }
+        }
+
+        Ort::IoBinding binding(decoder_with_past);
+        Ort::RunOptions run_options;
+        binding.BindInput("input_ids", inputs[0]);
+        binding.BindInput("past_key_values.0.encoder.key", first[2]);
+        binding.BindOutput("logits", logits_tensor);
+        int64_t length = prompt_length;
+        auto step = [&](){
+            const int current = static_cast<int>(length % 2);
+            binding.BindInput("past_key_values.0.decoder.key", cache_views[current][length]);
+            binding.BindOutput("present.0.decoder.key", cache_views[1 - current][length + 1]);
+            decoder_with_past.Run(run_options, binding);
+            ++length;
+        };
+        for(int i = 0; i < warm_steps; ++i){
+            step();
+        }
+        const std::size_t onnxruntime_allocations = count_allocations([&](){
+            for(int i = 0; i < measured_steps; ++i){
+                step();
+            }
+        });
+
+        std::cout << "allocations in " << measured_steps << " warm cached steps: decoder " << decoder_allocations
+                  << ", onnxruntime alone " << onnxruntime_allocations << std::endl;
+        //a step of ours that allocates adds at least measured_steps; the slack
+        //only absorbs onnxruntime's own run-to-run variation
+        if(decoder_allocations > onnxruntime_allocations + measured_steps / 4){
+            std::cerr << "a warmed-up cached decoder step allocates" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }catch(const Ort::Exception & e){
+        std::cerr << "decoder allocations test failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
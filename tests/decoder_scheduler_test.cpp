@@ -0,0 +1,163 @@
+//file:: decoder_scheduler_test.cpp
+// sequences submitted to a DecoderScheduler from several threads at once come
+// back with the tokens they get decoded alone, with and without the KV cache.
+// meant to run under -fsanitize=address or thread as well
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <future>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <onnxruntime/onnxruntime_cxx_api.h>
+
+#include "include/decoder_scheduler.hpp"
+
+
+namespace{
+
+    // ctest's SKIP_RETURN_CODE, for a tree without the tiny models
+    constexpr int skipped = 77;
+
+    constexpr int sequence_count = 24;
+    constexpr int submit_threads = 4;
+    constexpr int64_t encoder_dim = 12;
+    // stand-ins for sot and notimestamps, the prompt transcriptions start with
+    const std::vector<int64_t> prompt = {1, 2};
+
+    struct Chunk{
+        std::vector<float> data;
+        Ort::Value encoder_output{nullptr};
+        std::vector<int64_t> prompt;
+        int max_length = 0;
+    };
+
+    // two frame counts so cohorts never mix encoder shapes, and a spread of
+    // max_length so sequences leave, and uncached calls pad, at different steps
+    std::vector<Chunk> make_chunks(){
+        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtAllocatorType::OrtArenaAllocator, OrtMemType::OrtMemTypeDefault);
+        std::vector<Chunk> chunks(sequence_count);
+        for(int i = 0; i < sequence_count; ++i){
+            Chunk & chunk = chunks[i];
+            const int64_t frames = i % 4 == 3 ? 4 : 6;
+            chunk.data.resize(frames * encoder_dim);
+            for(std::size_t j = 0; j < chunk.data.size(); ++j){
+                chunk.data[j] = static_cast<float>((i * 7 + j * 3) % 11) * 0.2f - 1.0f;
+            }
+            std::array<int64_t, 3> shape = {1, frames, encoder_dim};
+            chunk.encoder_output = Ort::Value::CreateTensor<float>(memory_info, chunk.data.data(), chunk.data.size(), shape.data(), shape.size());
+            chunk.prompt = prompt;
+            chunk.max_length = 4 + i % 13;
+        }
+        return chunks;
+    }
+
+    // every chunk submitted from submit_threads threads, results by chunk
+    std::vector<AIvoice::DecodeResult> submit_all(AIvoice::DecoderScheduler & scheduler, const std::vector<Chunk> & chunks, int64_t eot, const AIvoice::DecodeGuardOptions & guard){
+        std::vector<AIvoice::DecodeResult> results(chunks.size());
+        std::vector<std::exception_ptr> errors(submit_threads);
+        std::vector<std::thread> threads;
+        for(int t = 0; t < submit_threads; ++t){
+            threads.emplace_back([&, t](){
+                try{
+                    std::vector<std::pair<std::size_t, std::future<AIvoice::DecodeResult>>> pending;
+                    for(std::size_t i = t; i < chunks.size(); i += submit_threads){
+                        pending.emplace_back(i, scheduler.submit(chunks[i].encoder_output, chunks[i].prompt, eot, chunks[i].max_length, guard));
+                    }
+                    for(auto & [i, result] : pending){
+                        results[i] = result.get();
+                    }
+                }catch(...){
+                    errors[t] = std::current_exception();
+                }
+            });
+        }
+        for(auto & thread : threads){
+            thread.join();
+        }
+        for(auto & error : errors){
+            if(error){
+                std::rethrow_exception(error);
+            }
+        }
+        return results;
+    }
+
+    bool check(const AIvoice::WhisperDecoder & decoder, const std::vector<Chunk> & chunks, int64_t eot, const char * mode){
+        AIvoice::DecoderScheduler scheduler(decoder, AIvoice::DecoderSchedulerOptions{6, std::chrono::microseconds(500)});
+
+        //no early stops: the tokens of the uncached loop
+        AIvoice::DecodeGuardOptions off;
+        off.ngram_size = 0;
+        off.max_compression_ratio = 0.0f;
+        off.min_avg_logprob = 0.0f;
+        off.no_speech_threshold = 1.0f;
+        std::vector<AIvoice::DecodeResult> results = submit_all(scheduler, chunks, eot, off);
+        for(std::size_t i = 0; i < chunks.size(); ++i){
+            std::vector<int64_t> expected = decoder.greedy_full(chunks[i].encoder_output, chunks[i].prompt, eot, chunks[i].max_length);
+            if(results[i].tokens != expected){
+                std::cerr << mode << ": chunk " << i << " decoded differently in a batch" << std::endl;
+                return false;
+            }
+        }
+
+        //the default guard: what decode() returns for the chunk alone
+        AIvoice::DecodeGuardOptions guard;
+        guard.min_tokens = 4;
+        results = submit_all(scheduler, chunks, eot, guard);
+        AIvoice::WhisperDecoder::Workspace workspace;
+        for(std::size_t i = 0; i < chunks.size(); ++i){
+            AIvoice::DecodeResult expected = decoder.decode(chunks[i].encoder_output, chunks[i].prompt, eot, chunks[i].max_length, guard, workspace);
+            if(results[i].tokens != expected.tokens || results[i].stop_reason != expected.stop_reason || results[i].steps != expected.steps){
+                std::cerr << mode << ": chunk " << i << " stopped differently in a batch" << std::endl;
+                return false;
+            }
+        }
+        std::cout << mode << ": " << chunks.size() << " chunks match, " << scheduler.stats().dump() << std::endl;
+        return true;
+    }
+}
+
+int main(int argc, char ** argv){
+    const std::filesystem::path model_dir = argc > 1 ? argv[1] : "tiny_whisper";
+    const std::string decoder_path = (model_dir / "decoder.onnx").string();
+    const std::string decoder_with_past_path = (model_dir / "decoder_with_past.onnx").string();
+    if(!std::filesystem::exists(decoder_path) || !std::filesystem::exists(decoder_with_past_path)){
+        std::cout << "no tiny Whisper models in " << model_dir << " (tests/make_tiny_whisper.py), skipping" << std::endl;
+        return skipped;
+    }
+
+    try{
+        Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "decoder_scheduler_test");
+        Ort::SessionOptions session_options;
+        session_options.SetIntraOpNumThreads(1);
+        session_options.SetInterOpNumThreads(1);
+        Ort::Session decoder(env, decoder_path.c_str(), session_options);
+        Ort::Session decoder_with_past(env, decoder_with_past_path.c_str(), session_options);
+
+        const std::vector<Chunk> chunks = make_chunks();
+
+        AIvoice::WhisperDecoder uncached(decoder, nullptr);
+        AIvoice::WhisperDecoder cached(decoder, &decoder_with_past);
+        if(!cached.uses_cache()){
+            std::cerr << "the tiny decoder pair was not taken for a KV cache layout" << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        //a token the first chunk produces, so some chunks end on eot
+        const std::vector<int64_t> open = uncached.greedy_full(chunks[0].encoder_output, chunks[0].prompt, -1, 3);
+        const int64_t eot = open.back();
+
+        if(!check(uncached, chunks, eot, "uncached") || !check(cached, chunks, eot, "cached")){
+            return EXIT_FAILURE;
+        }
+    }catch(const Ort::Exception & e){
+        std::cerr << "decoder scheduler test failed: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+//file:: http_session_test.cpp
+// a keep-alive connection with an idle timeout longer than the write timeout
+// stays open past the write timeout after a response and is closed by the
+// idle timeout, and a request body still arriving while an earlier response
+// is written gets the read timeout: writes have their own deadline and leave
+// the read's alone. a response its client stops reading is still cut off at
+// the write timeout
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+
+#include "include/http_session.hpp"
+
+
+namespace{
+
+    namespace http = boost::beast::http;
+    using tcp = boost::asio::ip::tcp;
+
+    constexpr std::size_t large_body = 256 * 1024 * 1024;
+
+    int failures = 0;
+
+    void expect(bool ok, const char * what){
+        if(!ok){
+            std::cerr << "failed: " << what << std::endl;
+            ++failures;
+        }
+    }
+
+    // one request on `stream`, true when its response came back
+    bool round_trip(boost::beast::tcp_stream & stream, boost::beast::flat_buffer & buffer){
+        AIvoice::HttpRequest req{http::verb::get, "/", 11};
+        req.set(http::field::host, "localhost");
+        req.keep_alive(true);
+        boost::beast::error_code ec;
+        http::write(stream, req, ec);
+        if(ec){
+            return false;
+        }
+        AIvoice::HttpResponse res;
+        http::read(stream, buffer, res, ec);
+        return !ec && res.result() == http::status::ok;
+    }
+}
+
+int main(){
+    AIvoice::HttpSessionOptions options;
+    options.idle_timeout = std::chrono::seconds(4);
+    options.read_timeout = std::chrono::seconds(4);
+    options.write_timeout = std::chrono::seconds(1);
+
+    boost::asio::io_context ioc;
+    tcp::acceptor acceptor(ioc, tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    std::function<void()> do_accept = [&](){
+        acceptor.async_accept(
+            boost::asio::make_strand(ioc),
+            [&](boost::beast::error_code ec, tcp::socket socket){
+                if(ec){
+                    return;
+                }
+                std::make_shared<AIvoice::HttpSession>(
+                    std::move(socket),
+                    [](AIvoice::HttpRequest && req, AIvoice::ResponseSender send){
+                        AIvoice::HttpResponse res{http::status::ok, req.version()};
+                        res.keep_alive(req.keep_alive());
+                        // far more than the socket buffers hold, for a client that stops reading
+                        res.body() = req.target() == "/large" ? std::string(large_body, 'x') : std::string("ok");
+                        res.prepare_payload();
+                        send(std::move(res));
+                    },
+                    options
+                )->start();
+                do_accept();
+            }
+        );
+    };
+    do_accept();
+    std::thread server([&ioc](){ ioc.run(); });
+
+    {
+        boost::asio::io_context client_ioc;
+        boost::beast::tcp_stream stream(client_ioc);
+        stream.connect(acceptor.local_endpoint());
+        boost::beast::flat_buffer buffer;
+
+        expect(round_trip(stream, buffer), "the first request is answered");
+        std::this_thread::sleep_for(options.write_timeout * 2);
+        expect(round_trip(stream, buffer), "the connection outlives the write timeout while idle");
+
+        //a GET answered while the POST after it still waits for its body
+        const std::string pipelined =
+            "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"
+            "POST / HTTP/1.1\r\nHost: localhost\r\nContent-Length: 4\r\n\r\n";
+        boost::asio::write(stream.socket(), boost::asio::buffer(pipelined));
+        AIvoice::HttpResponse first;
+        boost::beast::error_code first_ec;
+        http::read(stream, buffer, first, first_ec);
+        expect(!first_ec && first.result() == http::status::ok, "the pipelined GET is answered");
+        std::this_thread::sleep_for(options.write_timeout * 2);
+        boost::asio::write(stream.socket(), boost::asio::buffer(std::string("body")));
+        AIvoice::HttpResponse second;
+        boost::beast::error_code second_ec;
+        http::read(stream, buffer, second, second_ec);
+        expect(!second_ec && second.result() == http::status::ok, "a body slower than the write timeout is read within the read timeout");
+
+        //nothing more to send: the idle timeout, not the write timeout, ends it
+        const auto idle_start = std::chrono::steady_clock::now();
+        AIvoice::HttpResponse res;
+        boost::beast::error_code ec;
+        http::read(stream, buffer, res, ec);
+        const auto idle = std::chrono::steady_clock::now() - idle_start;
+        expect(ec == http::error::end_of_stream, "the idle connection is closed");
+        expect(idle > options.idle_timeout - std::chrono::milliseconds(500), "the idle connection is closed by the idle timeout");
+    }
+
+    {
+        boost::asio::io_context client_ioc;
+        boost::beast::tcp_stream stream(client_ioc);
+        stream.connect(acceptor.local_endpoint());
+        const std::string request = "GET /large HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        boost::asio::write(stream.socket(), boost::asio::buffer(request));
+        std::this_thread::sleep_for(options.write_timeout * 3);
+
+        //what the socket buffers held before the write timeout closed the connection
+        boost::beast::flat_buffer buffer;
+        http::response_parser<http::string_body> parser;
+        parser.body_limit(large_body * 2);
+        boost::beast::error_code ec;
+        http::read(stream, buffer, parser, ec);
+        expect(ec && parser.get().body().size() < large_body, "a response the client stops reading is cut off at the write timeout");
+    }
+
+    ioc.stop();
+    server.join();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,135 @@
+#!/usr/bin/env python3
+"""Writes a tiny Whisper-shaped decoder pair for the C++ tests.
+
+decoder.onnx takes input_ids [batch, length] and encoder_hidden_states
+[batch, frames, dim] and returns logits [batch, length, vocab] plus
+present.0.decoder.key and present.0.encoder.key. decoder_with_past.onnx
+takes one token per row and the past_key_values.0.* of those outputs, and
+returns the next logits and the grown present.0.decoder.key, the layout
+optimum exports for Whisper.
+
+There is no attention: a position's logits come from the sum of the token
+embeddings up to it plus the mean of the projected encoder states, so both
+models produce the same tokens and the plain decoder's padding never
+reaches earlier positions.
+
+    python3 tests/make_tiny_whisper.py <output dir>
+
+Without onnx it writes nothing and exits 0, the tests then skip themselves.
+"""
+
+import os
+import sys
+
+try:
+    import numpy as np
+    import onnx
+    from onnx import helper, numpy_helper, TensorProto
+except ImportError as e:
+    print(f"not writing the tiny Whisper models: {e}")
+    sys.exit(0)
+
+
+VOCAB = 100
+DIM = 8
+ENCODER_DIM = 12
+OPSET = 17
+# readable by onnxruntime releases older than the onnx package writing it
+IR_VERSION = 8
+
+
+def weights(rng):
+    return {
+        "token_embedding": rng.standard_normal((VOCAB, DIM)).astype(np.float32),
+        "cross_projection": rng.standard_normal((ENCODER_DIM, DIM)).astype(np.float32),
+        "output_projection": (4.0 * rng.standard_normal((DIM, VOCAB))).astype(np.float32),
+        "scale": np.array([0.7], dtype=np.float32),
+    }
+
+
+def initializers(w, names):
+    return [numpy_helper.from_array(w[name], name) for name in names]
+
+
+def int64s(name, values):
+    return numpy_helper.from_array(np.array(values, dtype=np.int64), name)
+
+
+def logits_nodes(summed, cross_mean):
+    # sin(scale * summed + cross_mean) @ output_projection
+    return [
+        helper.make_node("Mul", [summed, "scale"], ["scaled"]),
+        helper.make_node("Add", ["scaled", cross_mean], ["hidden_pre"]),
+        helper.make_node("Sin", ["hidden_pre"], ["hidden"]),
+        helper.make_node("MatMul", ["hidden", "output_projection"], ["logits"]),
+    ]
+
+
+def decoder(w):
+    nodes = [
+        helper.make_node("Gather", ["token_embedding", "input_ids"], ["embedded"]),
+        helper.make_node("CumSum", ["embedded", "sequence_axis"], ["summed"]),
+        helper.make_node("MatMul", ["encoder_hidden_states", "cross_projection"], ["cross"]),
+        helper.make_node("ReduceMean", ["cross"], ["cross_mean"], axes=[1], keepdims=1),
+        helper.make_node("Unsqueeze", ["embedded", "axis_1"], ["present.0.decoder.key"]),
+        helper.make_node("Unsqueeze", ["cross", "axis_1"], ["present.0.encoder.key"]),
+    ] + logits_nodes("summed", "cross_mean")
+
+    graph = helper.make_graph(
+        nodes, "tiny_whisper_decoder",
+        [
+            helper.make_tensor_value_info("input_ids", TensorProto.INT64, ["batch", "length"]),
+            helper.make_tensor_value_info("encoder_hidden_states", TensorProto.FLOAT, ["batch", "frames", ENCODER_DIM]),
+        ],
+        [
+            helper.make_tensor_value_info("logits", TensorProto.FLOAT, ["batch", "length", VOCAB]),
+            helper.make_tensor_value_info("present.0.decoder.key", TensorProto.FLOAT, ["batch", 1, "length", DIM]),
+            helper.make_tensor_value_info("present.0.encoder.key", TensorProto.FLOAT, ["batch", 1, "frames", DIM]),
+        ],
+        initializers(w, ["token_embedding", "cross_projection", "output_projection", "scale"]) + [int64s("axis_1", [1]), int64s("sequence_axis", 1)],
+    )
+    return helper.make_model(graph, opset_imports=[helper.make_opsetid("", OPSET)], ir_version=IR_VERSION)
+
+
+def decoder_with_past(w):
+    nodes = [
+        helper.make_node("Gather", ["token_embedding", "input_ids"], ["embedded"]),
+        helper.make_node("Unsqueeze", ["embedded", "axis_1"], ["embedded_key"]),
+        helper.make_node("Concat", ["past_key_values.0.decoder.key", "embedded_key"], ["present.0.decoder.key"], axis=2),
+        helper.make_node("ReduceSum", ["present.0.decoder.key", "axis_2"], ["summed"], keepdims=0),
+        helper.make_node("ReduceMean", ["past_key_values.0.encoder.key"], ["cross_mean"], axes=[2], keepdims=0),
+    ] + logits_nodes("summed", "cross_mean")
+
+    graph = helper.make_graph(
+        nodes, "tiny_whisper_decoder_with_past",
+        [
+            helper.make_tensor_value_info("input_ids", TensorProto.INT64, ["batch", 1]),
+            helper.make_tensor_value_info("past_key_values.0.decoder.key", TensorProto.FLOAT, ["batch", 1, "past", DIM]),
+            helper.make_tensor_value_info("past_key_values.0.encoder.key", TensorProto.FLOAT, ["batch", 1, "frames", DIM]),
+        ],
+        [
+            helper.make_tensor_value_info("logits", TensorProto.FLOAT, ["batch", 1, VOCAB]),
+            helper.make_tensor_value_info("present.0.decoder.key", TensorProto.FLOAT, ["batch", 1, "length", DIM]),
+        ],
+        initializers(w, ["token_embedding", "output_projection", "scale"]) + [int64s("axis_1", [1]), int64s("axis_2", [2])],
+    )
+    return helper.make_model(graph, opset_imports=[helper.make_opsetid("", OPSET)], ir_version=IR_VERSION)
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__)
+        return 2
+    out_dir = sys.argv[1]
+    os.makedirs(out_dir, exist_ok=True)
+
+    w = weights(np.random.default_rng(7))
+    for name, model in (("decoder.onnx", decoder(w)), ("decoder_with_past.onnx", decoder_with_past(w))):
+        onnx.checker.check_model(model)
+        onnx.save(model, os.path.join(out_dir, name))
+    print(f"tiny Whisper decoder written to {out_dir}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Rewrites a Whisper decoder_model.onnx to return logits for one position per row.
+
+The stock export projects every position of input_ids onto the vocabulary and
+returns [batch, length, vocab] logits, of which greedy decoding reads one row.
+This adds an int64 input `last_positions` [batch, k] and gathers the hidden
+states at those positions right before the vocabulary projection, so the
+projection runs k times per row and `logits` becomes [batch, k, vocab]. aivoice
+passes the last position, led by position 0 at a chunk's first step, where it
+reads the no-speech probability at the start of transcript.
+
+aivoice detects the `last_positions` input and feeds it, so the rewritten
+model is a drop-in replacement for --decoder-model. decoder_with_past already
+returns one position per step and needs no rewrite.
+
+    python3 tools/trim_decoder_logits.py decoder_model.onnx decoder_model_last.onnx --check
+"""
+
+import argparse
+import sys
+
+import numpy as np
+import onnx
+from onnx import helper, numpy_helper, TensorProto
+
+
+POSITIONS_INPUT = "last_positions"
+LOGITS_OUTPUT = "logits"
+# ops between the vocabulary projection and `logits` that act per position
+PASS_THROUGH_OPS = {"Add", "Cast", "Identity", "Mul", "Div"}
+
+
+def opset_version(model):
+    for opset in model.opset_import:
+        if opset.domain in ("", "ai.onnx"):
+            return opset.version
+    return 1
+
+
+def find_projection(graph, vocab_size):
+    """The MatMul (or Gemm) that maps hidden states to `vocab_size` logits, and its activation input."""
+    producers = {output: node for node in graph.node for output in node.output}
+    initializers = {init.name: init for init in graph.initializer}
+
+    name = LOGITS_OUTPUT
+    while name in producers:
+        node = producers[name]
+        if node.op_type in ("MatMul", "Gemm"):
+            weight = initializers.get(node.input[1])
+            if weight is not None and weight.dims and weight.dims[-1] == vocab_size:
+                return node, node.input[0]
+            if weight is not None and node.op_type == "Gemm" and weight.dims and weight.dims[0] == vocab_size:
+                return node, node.input[0]
+            return None, None
+        if node.op_type not in PASS_THROUGH_OPS:
+            return None, None
+        # follow the activation, not the constant operand
+        activations = [i for i in node.input if i and i not in initializers]
+        if len(activations) != 1:
+            return None, None
+        name = activations[0]
+    return None, None
+
+
+def logits_vocab_size(graph):
+    for output in graph.output:
+        if output.name == LOGITS_OUTPUT:
+            dims = output.type.tensor_type.shape.dim
+            if dims and dims[-1].HasField("dim_value"):
+                return dims[-1].dim_value
+    return None
+
+
+def gather_nodes(hidden, gathered, opset):
+    """Nodes computing gathered[b, i, :] = hidden[b, last_positions[b, i], :]."""
+    prefix = "trim_logits/"
+    nodes = []
+    initializers = [
+        numpy_helper.from_array(np.array([0], dtype=np.int64), prefix + "zero"),
+        numpy_helper.from_array(np.array([1], dtype=np.int64), prefix + "one"),
+        numpy_helper.from_array(np.array([2], dtype=np.int64), prefix + "two"),
+    ]
+
+    nodes.append(helper.make_node("Shape", [hidden], [prefix + "shape"]))
+    nodes.append(helper.make_node("Gather", [prefix + "shape", prefix + "zero"], [prefix + "batch"], axis=0))
+    nodes.append(helper.make_node("Gather", [prefix + "shape", prefix + "two"], [prefix + "width"], axis=0))
+    nodes.append(helper.make_node("Shape", [POSITIONS_INPUT], [prefix + "positions_shape"]))
+    nodes.append(helper.make_node("Gather", [prefix + "positions_shape", prefix + "one"], [prefix + "count"], axis=0))
+    nodes.append(helper.make_node("Concat", [prefix + "batch", prefix + "count", prefix + "width"], [prefix + "index_shape"], axis=0))
+
+    if opset >= 13:
+        nodes.append(helper.make_node("Unsqueeze", [POSITIONS_INPUT, prefix + "two"], [prefix + "positions"]))
+    else:
+        nodes.append(helper.make_node("Unsqueeze", [POSITIONS_INPUT], [prefix + "positions"], axes=[2]))
+
+    nodes.append(helper.make_node("Expand", [prefix + "positions", prefix + "index_shape"], [prefix + "index"]))
+    nodes.append(helper.make_node("GatherElements", [hidden, prefix + "index"], [gathered], axis=1))
+    return nodes, initializers
+
+
+def trim(model):
+    graph = model.graph
+    if any(i.name == POSITIONS_INPUT for i in graph.input):
+        raise ValueError("model already takes " + POSITIONS_INPUT)
+    if not any(o.name == LOGITS_OUTPUT for o in graph.output):
+        raise ValueError("model has no " + LOGITS_OUTPUT + " output")
+
+    opset = opset_version(model)
+    if opset < 11:
+        raise ValueError("GatherElements needs opset 11, the model has %d" % opset)
+
+    vocab_size = logits_vocab_size(graph)
+    projection, hidden = find_projection(graph, vocab_size) if vocab_size else (None, None)
+
+    if projection is not None:
+        # gather before the projection: the MatMul then only sees one position per row
+        gathered = hidden + "/last_position"
+        nodes, initializers = gather_nodes(hidden, gathered, opset)
+        for i, name in enumerate(projection.input):
+            if name == hidden:
+                projection.input[i] = gathered
+        index = list(graph.node).index(projection)
+        for offset, node in enumerate(nodes):
+            graph.node.insert(index + offset, node)
+        where = "before " + (projection.name or projection.op_type)
+    else:
+        # unrecognised head: gather the finished logits, which still trims the output
+        full = LOGITS_OUTPUT + "/all_positions"
+        for node in graph.node:
+            for i, name in enumerate(node.output):
+                if name == LOGITS_OUTPUT:
+                    node.output[i] = full
+        nodes, initializers = gather_nodes(full, LOGITS_OUTPUT, opset)
+        graph.node.extend(nodes)
+        where = "after the logits (projection not found)"
+
+    graph.initializer.extend(initializers)
+    graph.input.append(helper.make_tensor_value_info(POSITIONS_INPUT, TensorProto.INT64, ["batch_size", "positions"]))
+
+    for output in graph.output:
+        if output.name == LOGITS_OUTPUT:
+            dims = output.type.tensor_type.shape.dim
+            if len(dims) >= 2:
+                dims[1].Clear()
+                dims[1].dim_param = "positions"
+    # value_info for the old [batch, length, ...] tensors downstream of the gather would now be wrong
+    del graph.value_info[:]
+    return where
+
+
+def check(original_path, trimmed_path):
+    """Runs both models on random input and compares the logits at each row's positions."""
+    import onnxruntime as ort
+
+    original = ort.InferenceSession(original_path, providers=["CPUExecutionProvider"])
+    trimmed = ort.InferenceSession(trimmed_path, providers=["CPUExecutionProvider"])
+
+    rng = np.random.default_rng(0)
+    batch, length = 2, 5
+    feeds = {}
+    for model_input in original.get_inputs():
+        shape = [d if isinstance(d, int) else None for d in model_input.shape]
+        if model_input.name == "input_ids":
+            feeds[model_input.name] = rng.integers(0, 50000, size=(batch, length), dtype=np.int64)
+        else:
+            concrete = [batch if i == 0 else (d if d is not None else 1500) for i, d in enumerate(shape)]
+            feeds[model_input.name] = rng.standard_normal(concrete).astype(np.float32)
+
+    all_positions = original.run([LOGITS_OUTPUT], feeds)[0]
+    names = [o.name for o in trimmed.get_outputs()]
+    ok = True
+    # a later step's last position, and a first step's start of transcript and last position
+    for positions in ([[length - 1], [length - 3]], [[0, length - 1], [0, length - 3]]):
+        positions = np.array(positions, dtype=np.int64)
+        expected = all_positions[np.arange(batch)[:, None], positions]
+        feeds[POSITIONS_INPUT] = positions
+        got = trimmed.run(None, feeds)[names.index(LOGITS_OUTPUT)]
+        error = float(np.max(np.abs(got - expected)))
+        print("check: logits %s, max abs difference %g" % (list(got.shape), error))
+        ok = ok and got.shape == expected.shape and error < 1e-3
+    return ok
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="decoder_model.onnx")
+    parser.add_argument("output", help="where to write the rewritten model")
+    parser.add_argument("--check", action="store_true", help="compare both models with onnxruntime")
+    args = parser.parse_args()
+
+    model = onnx.load(args.input)
+    try:
+        where = trim(model)
+    except ValueError as error:
+        print("error: %s" % error, file=sys.stderr)
+        return 1
+
+    # models over 2 GB cannot be one protobuf, those are saved and checked by path
+    large = model.ByteSize() > 2_000_000_000
+    onnx.save(model, args.output, save_as_external_data=large)
+    onnx.checker.check_model(args.output if large else model)
+    print("gathered last_positions %s, wrote %s" % (where, args.output))
+
+    if args.check and not check(args.input, args.output):
+        print("error: rewritten model disagrees with the original", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())